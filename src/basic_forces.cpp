@@ -18,6 +18,7 @@
  *************************************************************************/
 
 #include <carom.hpp>
+#include <vector>
 
 namespace carom
 {
@@ -25,6 +26,27 @@ namespace carom
   constant_force::~constant_force() { }
   vector_force constant_force::force(const particle& x) const { return m_F; }
 
+  bool constant_force::jacobian(const particle& x, scalar* J) const {
+    return true;
+  }
+
+  bool constant_force::jerk(const particle& x, scalar* dF) const {
+    return true;
+  }
+
+  bool constant_force::taylor(const particle& x, const taylor_state& state,
+                              std::vector<series>& w, unsigned int k,
+                              scalar* F) const {
+    if (k == 0) {
+      scalar F0[3];
+      flatten(m_F, F0);
+      for (unsigned int i = 0; i < 3; ++i) {
+        F[i] += F0[i];
+      }
+    }
+    return true;
+  }
+
   centripetal_force::centripetal_force(const vector_displacement& o)
     : m_o(o) { }
   centripetal_force::~centripetal_force() { }
@@ -35,9 +57,44 @@ namespace carom
     return -x.m()*norm(x.v())*norm(x.v())*normalized(r)/norm(r);
   }
 
+  bool centripetal_force::taylor(const particle& x, const taylor_state& state,
+                                 std::vector<series>& w, unsigned int k,
+                                 scalar* F) const {
+    // F = -(p.p/m)*r/(r.r), with r = s - o
+    const series* s = state.s(x);
+    const series* p = state.p(x);
+    w.resize(9);
+    series* r = &w[0];
+
+    scalar o[3];
+    flatten(m_o, o);
+    for (unsigned int i = 0; i < 3; ++i) {
+      r[i][k] = s[i][k];
+      if (k == 0) {
+        r[i][k] -= o[i];
+      }
+    }
+
+    dot(w[3], p, p, k);
+    dot(w[4], r, r, k);
+    if (k == 0 && sgn(w[4][0]) == 0) {
+      return false;
+    }
+    divide(w[5], w[3], w[4], k);
+
+    scalar c = convert<scalar>(-1/x.m());
+    for (unsigned int i = 0; i < 3; ++i) {
+      multiply(w[6 + i], w[5], r[i], k);
+      F[i].addmul(c, w[6 + i][k]);
+    }
+    return true;
+  }
+
   scalar_gravitational_constant gravitational_force::s_G("6.693e-11");
 
-  gravitational_force::gravitational_force(const particle& x) : m_x(&x) { }
+  gravitational_force::gravitational_force(const particle& x) : m_x(&x) {
+    scale(slow);
+  }
   gravitational_force::~gravitational_force() { }
 
   scalar_gravitational_constant gravitational_force::G() { return s_G; }
@@ -46,12 +103,66 @@ namespace carom
     s_G = G;
   }
 
+  const particle& gravitational_force::source() const { return *m_x; }
+
   vector_force gravitational_force::force(const particle& x) const {
     // F = G*m1*m2/r^2
     vector_displacement r = x.s() - m_x->s();
     return -G()*x.m()*m_x->m()*normalized(r)/(norm(r)*norm(r));
   }
 
+  bool gravitational_force::jerk(const particle& x, scalar* dF) const {
+    // dF/dt = -G*m1*m2*(v/|r|^3 - 3*(r.v)*r/|r|^5), with r = s1 - s2 and
+    // v = v1 - v2
+    vector_displacement r = x.s() - m_x->s();
+    if (r == 0) {
+      return false;
+    }
+    vector_velocity v = x.v() - m_x->v();
+
+    scalar r2 = convert<scalar>(dot(r, r));
+    scalar c = convert<scalar>(-G()*x.m()*m_x->m()/(norm(r)*dot(r, r)));
+    scalar d = convert<scalar>(-3*dot(r, v))/r2;
+    scalar ri[3], vi[3];
+    flatten(r, ri);
+    flatten(v, vi);
+    for (unsigned int i = 0; i < 3; ++i) {
+      vi[i].addmul(d, ri[i]);
+      dF[i].addmul(c, vi[i]);
+    }
+    return true;
+  }
+
+  bool gravitational_force::taylor(const particle& x,
+                                   const taylor_state& state,
+                                   std::vector<series>& w, unsigned int k,
+                                   scalar* F) const {
+    // F = -G*m1*m2*r/|r|^3, with r = s1 - s2
+    const series* s1 = state.s(x);
+    const series* s2 = state.s(*m_x);
+    if (!s2) {
+      return false;
+    }
+    w.resize(8);
+    series* r = &w[0];
+
+    for (unsigned int i = 0; i < 3; ++i) {
+      subtract(r[i], s1[i], s2[i], k);
+    }
+    dot(w[3], r, r, k);
+    if (k == 0 && sgn(w[3][0]) == 0) {
+      return false;
+    }
+    pow(w[4], w[3], -scalar(3)/2, k);
+
+    scalar c = convert<scalar>(-G()*x.m()*m_x->m());
+    for (unsigned int i = 0; i < 3; ++i) {
+      multiply(w[5 + i], w[4], r[i], k);
+      F[i].addmul(c, w[5 + i][k]);
+    }
+    return true;
+  }
+
   spring_force::spring_force(const vector_displacement& o,
                              const scalar_distance& l,
                              const scalar_spring_constant& k)
@@ -67,4 +178,90 @@ namespace carom
       return 0;
     }
   }
+
+  bool spring_force::jacobian(const particle& x, scalar* J) const {
+    // dF/ds = -k*((1 - l/r)*I + (l/r)*u*u^T), with u the unit vector along r
+    vector_displacement r = x.s() - m_o;
+    if (r == 0) {
+      return false;
+    }
+
+    scalar k = convert<scalar>(m_k);
+    scalar c = convert<scalar>(m_l/norm(r));
+    scalar u[3];
+    flatten(normalized(r), u);
+
+    for (unsigned int i = 0; i < 3; ++i) {
+      for (unsigned int j = 0; j < 3; ++j) {
+        J[3*i + j] -= k*c*u[i]*u[j];
+      }
+      J[3*i + i] -= k*(1 - c);
+    }
+    return true;
+  }
+
+  bool spring_force::jerk(const particle& x, scalar* dF) const {
+    // dF/dt = -k*((1 - l/|r|)*v + l*(r.v)*r/|r|^3), with r = s - o
+    vector_displacement r = x.s() - m_o;
+    if (r == 0) {
+      return false;
+    }
+    vector_velocity v = x.v();
+
+    scalar k = convert<scalar>(-m_k);
+    scalar c = convert<scalar>(1 - m_l/norm(r));
+    scalar d = convert<scalar>(m_l*dot(r, v)/(norm(r)*dot(r, r)));
+    scalar ri[3], vi[3];
+    flatten(r, ri);
+    flatten(v, vi);
+    for (unsigned int i = 0; i < 3; ++i) {
+      vi[i] *= c;
+      vi[i].addmul(d, ri[i]);
+      dF[i].addmul(k, vi[i]);
+    }
+    return true;
+  }
+
+  bool spring_force::taylor(const particle& x, const taylor_state& state,
+                            std::vector<series>& w, unsigned int k,
+                            scalar* F) const {
+    // F = -k*(1 - l/|r|)*r, with r = s - o
+    const series* s = state.s(x);
+    w.resize(9);
+    series* r = &w[0];
+
+    scalar o[3];
+    flatten(m_o, o);
+    for (unsigned int i = 0; i < 3; ++i) {
+      r[i][k] = s[i][k];
+      if (k == 0) {
+        r[i][k] -= o[i];
+      }
+    }
+
+    scalar c = convert<scalar>(-m_k);
+    if (sgn(m_l) == 0) {
+      for (unsigned int i = 0; i < 3; ++i) {
+        F[i].addmul(c, r[i][k]);
+      }
+      return true;
+    }
+
+    // 1 - l/|r|
+    dot(w[3], r, r, k);
+    if (k == 0 && sgn(w[3][0]) == 0) {
+      return false;
+    }
+    pow(w[4], w[3], -scalar(1)/2, k);
+    w[5][k] = -convert<scalar>(m_l)*w[4][k];
+    if (k == 0) {
+      w[5][k] += 1;
+    }
+
+    for (unsigned int i = 0; i < 3; ++i) {
+      multiply(w[6 + i], w[5], r[i], k);
+      F[i].addmul(c, w[6 + i][k]);
+    }
+    return true;
+  }
 }
@@ -18,8 +18,10 @@
  *************************************************************************/
 
 #include <carom.hpp>
-#include <algorithm> // For max()
+#include <boost/bind/bind.hpp>
+#include <algorithm> // For max(), min(), find()
 #include <tr1/memory> // For shared_ptr
+#include <vector>
 
 namespace carom
 {
@@ -72,40 +74,52 @@ namespace carom
     return *this;
   }
 
+  k_value& k_value::axpy(const std::vector<scalar>& a,
+                         const std::vector<k_value>& k) {
+    if (!m_base || !m_base.unique()) {
+      m_base.reset(k.front().base()->clone());
+    }
+    m_base->axpy(a, k);
+    return *this;
+  }
+
   y_value::y_value() { }
   y_value::y_value(y_base* y) : m_base(y) { }
   y_base*       y_value::base()       { return m_base.get(); }
   const y_base* y_value::base() const { return m_base.get(); }
 
+  body::body() : m_threads(0) { }
   body::~body() { }
 
   body::iterator body::insert(particle* x) {
+    m_index.push_back(x);
     return m_particles.insert(m_particles.end(), x);
   }
 
-  void body::erase(body::iterator i) { m_particles.erase(i); }
+  void body::erase(body::iterator i) {
+    m_index.erase(std::find(m_index.begin(), m_index.end(), &*i));
+    m_particles.erase(i);
+  }
 
   body::iterator       body::begin()       { return m_particles.begin(); }
   body::const_iterator body::begin() const { return m_particles.begin(); }
   body::iterator       body::end()         { return m_particles.end(); }
   body::const_iterator body::end()   const { return m_particles.end(); }
 
-  std::size_t body::size() const { return m_particles.size(); }
+  std::size_t body::size() const { return m_index.size(); }
+
+  particle&       body::operator[](std::size_t i)       { return *m_index[i]; }
+  const particle& body::operator[](std::size_t i) const { return *m_index[i]; }
+
+  thread_pool* body::threads() const { return m_threads; }
+  void body::threads(thread_pool* pool) { m_threads = pool; }
 
   scalar_mass body::mass() const {
-    scalar_mass m = 0;
-    for (const_iterator i = begin(); i != end(); ++i) {
-      m += i->m();
-    }
-    return m;
+    return sum<scalar_mass>(&body::mass_of);
   }
 
   vector_displacement body::center_of_mass() const {
-    vector_units<1, 1, 0> r = 0;
-    for (const_iterator i = begin(); i != end(); ++i) {
-      r += i->m()*i->s();
-    }
-    return r/mass();
+    return sum<vector_units<1, 1, 0> >(&body::moment_of)/mass();
   }
 
   vector_velocity body::velocity() const {
@@ -113,11 +127,7 @@ namespace carom
   }
 
   vector_momentum body::momentum() const {
-    vector_momentum p = 0;
-    for (const_iterator i = begin(); i != end(); ++i) {
-      p += i->p();
-    }
-    return p;
+    return sum<vector_momentum>(&body::momentum_of);
   }
 
   vector_acceleration body::acceleration() const {
@@ -125,25 +135,74 @@ namespace carom
   }
 
   vector_force body::force() const {
-    vector_force F = 0;
-    for (const_iterator i = begin(); i != end(); ++i) {
-      F += i->F();
-    }
-    return F;
+    return sum<vector_force>(&body::force_of);
+  }
+
+  scalar_energy body::kinetic_energy() const {
+    return sum<scalar_energy>(&body::kinetic_energy_of);
   }
 
   void body::apply_forces() {
-    for (iterator i = begin(); i != end(); ++i) {
-      i->apply_forces();
-    }
+    each(boost::bind(&body::apply_forces_at, this, boost::placeholders::_1));
+  }
+
+  void body::apply_forces(applied_force::timescale scale) {
+    each(boost::bind(&body::apply_scaled_forces_at, this, scale,
+                     boost::placeholders::_1));
   }
 
   void body::apply(const y_value& y) {
     iterator i = begin();
     const_iterator j = y.base()->backup()->begin();
     for (; i != end(); ++i, ++j) {
-      i->s(j->s());
-      i->p(j->p());
+      i->assign(*j);
+    }
+  }
+
+  void body::y(y_value& y) {
+    if (!y.base() || y.base()->backup()->size() != size()) {
+      y = this->y();
+      return;
+    }
+
+    iterator i = y.base()->backup()->begin();
+    for (const_iterator j = begin(); j != end(); ++i, ++j) {
+      i->assign(*j);
+    }
+  }
+
+  void body::derivative(const scalar* y, scalar* dy) {
+    coordinate_derivative(y, dy);
+    momentum_derivative(y, dy);
+  }
+
+  void body::momentum_derivative(const scalar* y, scalar* dy) {
+    apply_forces();
+    force_derivative(y, dy);
+  }
+
+  void body::momentum_derivative(const scalar* y, scalar* dy,
+                                 applied_force::timescale scale) {
+    apply_forces(scale);
+    force_derivative(y, dy);
+  }
+
+  bool body::jacobian(const scalar* y, scalar* J, std::size_t stride) {
+    return false;
+  }
+
+  void body::error(const scalar* y, const scalar* e, error_norm& norm) const {
+    vector_displacement s, ds;
+    vector_momentum p, dp;
+    for (std::size_t i = 0; i < dimension(); i += 6) {
+      carom::unflatten(s,  y + i);
+      carom::unflatten(ds, e + i);
+      carom::unflatten(p,  y + i + 3);
+      carom::unflatten(dp, e + i + 3);
+      norm.add(error_norm::position, convert<scalar>(carom::norm(ds)),
+               convert<scalar>(carom::norm(s)));
+      norm.add(error_norm::momentum, convert<scalar>(carom::norm(dp)),
+               convert<scalar>(carom::norm(p)));
     }
   }
 
@@ -178,4 +237,52 @@ namespace carom
   scalar operator-(const y_value& lhs, const y_value& rhs) {
     return lhs.base()->subtract(*rhs.base());
   }
+
+  void body::each(const thread_pool::task& f) const {
+    each_chunk(boost::bind(&body::chunk, this, boost::cref(f),
+                           boost::placeholders::_1));
+  }
+
+  std::size_t body::chunks() const {
+    return (m_index.size() + s_chunk - 1)/s_chunk;
+  }
+
+  void body::each_chunk(const thread_pool::task& f) const {
+    if (m_threads) {
+      m_threads->run(chunks(), f);
+    } else {
+      for (std::size_t c = 0; c < chunks(); ++c) {
+        f(c);
+      }
+    }
+  }
+
+  void body::chunk(const thread_pool::task& f, std::size_t c) const {
+    std::size_t end = std::min(m_index.size(), (c + 1)*s_chunk);
+    for (std::size_t i = c*s_chunk; i < end; ++i) {
+      f(i);
+    }
+  }
+
+  void body::apply_forces_at(std::size_t i) {
+    m_index[i]->apply_forces();
+  }
+
+  void body::apply_scaled_forces_at(applied_force::timescale scale,
+                                    std::size_t i) {
+    m_index[i]->apply_forces(scale);
+  }
+
+  scalar_mass body::mass_of(const particle& x) { return x.m(); }
+
+  vector_units<1, 1, 0> body::moment_of(const particle& x) {
+    return x.m()*x.s();
+  }
+
+  vector_momentum body::momentum_of(const particle& x) { return x.p(); }
+  vector_force    body::force_of   (const particle& x) { return x.F(); }
+
+  scalar_energy body::kinetic_energy_of(const particle& x) {
+    return x.m()*norm(x.v())*norm(x.v())/2;
+  }
 }
@@ -21,17 +21,27 @@
 #define CAROM_HPP
 
 #include <carom/mpfr_utils.hpp>
+#include <carom/thread_pool.hpp>
 #include <carom/scalar.hpp>
 #include <carom/vector.hpp>
+#include <carom/error_norm.hpp>
+#include <carom/series.hpp>
 #include <carom/polymorphic_list.hpp>
 #include <carom/particle.hpp>
 #include <carom/body.hpp>
 #include <carom/system.hpp>
+#include <carom/tableau.hpp>
+#include <carom/step_controller.hpp>
+#include <carom/event.hpp>
+#include <carom/flat_state.hpp>
+#include <carom/taylor_state.hpp>
 #include <carom/integrator.hpp>
+#include <carom/flat_engine.hpp>
 #include <carom/mesh.hpp>
 #include <carom/impenetrable.hpp>
 #include <carom/simple_body.hpp>
 #include <carom/rigid_body.hpp>
+#include <carom/typed_engine.hpp>
 #include <carom/basic_forces.hpp>
 #include <carom/electromagnetism.hpp>
 
@@ -20,6 +20,8 @@
 #ifndef CAROM_BASIC_FORCES_HPP
 #define CAROM_BASIC_FORCES_HPP
 
+#include <vector>
+
 namespace carom
 {
   // More useful typedefs
@@ -33,6 +35,11 @@ namespace carom
     virtual ~constant_force();
 
     virtual vector_force force(const particle& x) const;
+    virtual bool jacobian(const particle& x, scalar* J) const;
+    virtual bool jerk(const particle& x, scalar* dF) const;
+    virtual bool taylor(const particle& x, const taylor_state& state,
+                        std::vector<series>& w, unsigned int k,
+                        scalar* F) const;
 
   private:
     vector_force m_F;
@@ -45,6 +52,9 @@ namespace carom
     virtual ~centripetal_force();
 
     virtual vector_force force(const particle& x) const;
+    virtual bool taylor(const particle& x, const taylor_state& state,
+                        std::vector<series>& w, unsigned int k,
+                        scalar* F) const;
 
   private:
     vector_displacement m_o;
@@ -59,7 +69,14 @@ namespace carom
     static scalar_gravitational_constant G();
     static void G(const scalar_gravitational_constant& G);
 
+    // The particle attracting x
+    const particle& source() const;
+
     virtual vector_force force(const particle& x) const;
+    virtual bool jerk(const particle& x, scalar* dF) const;
+    virtual bool taylor(const particle& x, const taylor_state& state,
+                        std::vector<series>& w, unsigned int k,
+                        scalar* F) const;
 
   private:
     const particle* m_x;
@@ -75,6 +92,11 @@ namespace carom
     virtual ~spring_force();
 
     virtual vector_force force(const particle& x) const;
+    virtual bool jacobian(const particle& x, scalar* J) const;
+    virtual bool jerk(const particle& x, scalar* dF) const;
+    virtual bool taylor(const particle& x, const taylor_state& state,
+                        std::vector<series>& w, unsigned int k,
+                        scalar* F) const;
 
   private:
     vector_displacement m_o;
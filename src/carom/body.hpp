@@ -21,13 +21,18 @@
 #define CAROM_BODY_HPP
 
 #include <boost/utility.hpp> // For noncopyable
+#include <boost/function.hpp>
+#include <boost/bind/bind.hpp>
 #include <tr1/memory> // For shared_ptr
+#include <algorithm> // For min()
+#include <vector>
 
 namespace carom
 {
   // Forward declarations
   class body;
   class k_base;
+  class k_value;
 
   class f_base
   {
@@ -54,6 +59,18 @@ namespace carom
     virtual k_base* subtract(const k_base& k) const = 0;
     virtual k_base* multiply(const scalar& n) const = 0;
     virtual k_base* divide  (const scalar& n) const = 0;
+
+    // Sets *this to a[0]*k[0] + a[1]*k[1] + ... + a[n - 1]*k[n - 1], where n
+    // is a.size(), in place. Every k[i] must have the same dynamic type as
+    // *this.
+    virtual void axpy(const std::vector<scalar>& a,
+                      const std::vector<k_value>& k) = 0;
+    virtual k_base* clone() const = 0;
+
+    // Adds the error of a step of size dt from the state y0 to norm, where
+    // *this is the difference between two estimates of the step's k-value
+    virtual void error(const body& y0, const scalar_time& dt,
+                       error_norm& norm) const = 0;
   };
 
   class y_base
@@ -110,6 +127,10 @@ namespace carom
     k_value& operator*=(const scalar& n);
     k_value& operator/=(const scalar& n);
 
+    // Like k_base::axpy, but allocates a k_base the first time, or if ours is
+    // shared with another k_value
+    k_value& axpy(const std::vector<scalar>& a, const std::vector<k_value>& k);
+
   private:
     std::tr1::shared_ptr<k_base> m_base;
   };
@@ -137,7 +158,7 @@ namespace carom
     typedef polymorphic_list<particle>::iterator       iterator;
     typedef polymorphic_list<particle>::const_iterator const_iterator;
 
-    // body();
+    body();
     virtual ~body();
 
     iterator insert(particle* x);
@@ -150,28 +171,139 @@ namespace carom
 
     std::size_t size() const;
 
+    // The i'th particle, in the order of begin() to end()
+    particle&       operator[](std::size_t i);
+    const particle& operator[](std::size_t i) const;
+
+    // The pool that loops over this body's particles are spread across, or 0
+    // to run them serially, the default. The pool isn't owned, and must
+    // outlive its use here.
+    thread_pool* threads() const;
+    void threads(thread_pool* pool);
+
     scalar_mass         mass          () const;
     vector_displacement center_of_mass() const;
     vector_velocity     velocity      () const;
     vector_momentum     momentum      () const;
     vector_acceleration acceleration  () const;
     vector_force        force         () const;
+    scalar_energy       kinetic_energy() const;
 
     // Needed for collision response
     virtual scalar_mass mass(const particle& x) const = 0;
     virtual void collision(particle& x, const vector_momentum& dp) = 0;
 
     void apply_forces();
+    void apply_forces(applied_force::timescale scale);
 
     virtual f_value f() = 0;
     virtual y_value y() = 0;
     virtual void step(const y_value& y0, const k_value& k) = 0;
     virtual void apply(const y_value& y);
 
+    // Overwrites the snapshot held by y with the current state, reusing its
+    // storage when it is a snapshot of this body. Copies of y see the change.
+    virtual void y(y_value& y);
+
+    // The flat state interface, used by flat_engine. The state is dimension()
+    // unitless scalars, relative to the snapshot y0; flatten() may only be
+    // called while the body is still in the state y0 holds. derivative()
+    // finds the time derivative of the state y, which must be the body's
+    // current state.
+    //
+    // The state is made of blocks of six: three coordinates, then their three
+    // conjugate momenta. coordinate_derivative() and momentum_derivative()
+    // fill in only the derivatives of the coordinates or of the momenta, for
+    // split methods like symplectic_integrator; only momentum_derivative()
+    // applies the forces, then leaves the rest to force_derivative(), which
+    // works from the forces the particles already hold. Given a timescale,
+    // momentum_derivative() applies only the forces on that timescale.
+    virtual std::size_t dimension() const = 0;
+    virtual void flatten(const y_value& y0, scalar* y) const = 0;
+    virtual void unflatten(const y_value& y0, const scalar* y) = 0;
+    virtual void derivative(const scalar* y, scalar* dy);
+    virtual void coordinate_derivative(const scalar* y, scalar* dy) = 0;
+    virtual void momentum_derivative(const scalar* y, scalar* dy);
+    void momentum_derivative(const scalar* y, scalar* dy,
+                             applied_force::timescale scale);
+    virtual void force_derivative(const scalar* y, scalar* dy) = 0;
+
+    // Adds the derivative of derivative() with respect to the body's own state
+    // to J, its diagonal block of a matrix with rows of length stride, for
+    // implicit integrators. Bodies which can't return false, and the block is
+    // found by finite differences instead.
+    virtual bool jacobian(const scalar* y, scalar* J, std::size_t stride);
+
+    // Adds the error e in the state y to norm. By default each block of six
+    // is a position and a momentum.
+    virtual void error(const scalar* y, const scalar* e,
+                       error_norm& norm) const;
+
+  protected:
+    // Calls f(i) for the index of every particle, in chunks spread across
+    // threads()
+    void each(const thread_pool::task& f) const;
+
+    // The sum of f(x) over the particles. Each chunk is summed in order, then
+    // the chunk sums pairwise, in a tree whose shape depends only on size(),
+    // so the result is the same however many threads there are.
+    template <typename T>
+    T sum(const boost::function<T (const particle&)>& f) const;
+
   private:
+    // Particles per chunk
+    static const std::size_t s_chunk = 64;
+
     polymorphic_list<particle> m_particles;
+    // The particles in order, for random access
+    std::vector<particle*> m_index;
+    thread_pool* m_threads;
+
+    std::size_t chunks() const;
+    void each_chunk(const thread_pool::task& f) const;
+    void chunk(const thread_pool::task& f, std::size_t c) const;
+    template <typename T>
+    void partial_sum(const boost::function<T (const particle&)>& f,
+                     std::vector<T>& sums, std::size_t c) const;
+
+    // The terms of the sums above, for particle x
+    static scalar_mass mass_of(const particle& x);
+    static vector_units<1, 1, 0> moment_of(const particle& x);
+    static vector_momentum momentum_of(const particle& x);
+    static vector_force force_of(const particle& x);
+    static scalar_energy kinetic_energy_of(const particle& x);
+
+    void apply_forces_at(std::size_t i);
+    void apply_scaled_forces_at(applied_force::timescale scale,
+                                std::size_t i);
   };
 
+  template <typename T>
+  T body::sum(const boost::function<T (const particle&)>& f) const {
+    std::vector<T> sums(chunks(), T(0));
+    each_chunk(boost::bind(&body::partial_sum<T>, this, boost::cref(f),
+                           boost::ref(sums), boost::placeholders::_1));
+
+    if (sums.empty()) {
+      return T(0);
+    }
+    for (std::size_t w = 1; w < sums.size(); w *= 2) {
+      for (std::size_t c = 0; c + w < sums.size(); c += 2*w) {
+        sums[c] += sums[c + w];
+      }
+    }
+    return sums[0];
+  }
+
+  template <typename T>
+  void body::partial_sum(const boost::function<T (const particle&)>& f,
+                         std::vector<T>& sums, std::size_t c) const {
+    std::size_t end = std::min(m_index.size(), (c + 1)*s_chunk);
+    for (std::size_t i = c*s_chunk; i < end; ++i) {
+      sums[c] += f(*m_index[i]);
+    }
+  }
+
   k_value operator*(const scalar_time& lhs, const f_value&     rhs);
   k_value operator*(const f_value&     lhs, const scalar_time& rhs);
   k_value operator+(const k_value&     lhs, const k_value&     rhs);
@@ -180,6 +312,7 @@ namespace carom
   k_value operator*(const k_value&     lhs, const scalar&      rhs);
   k_value operator/(const k_value&     lhs, const scalar&      rhs);
   scalar  operator-(const y_value&     lhs, const y_value&     rhs);
+
 }
 
 #endif // CAROM_BODY_HPP
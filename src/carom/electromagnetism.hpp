@@ -21,6 +21,7 @@
 #define CAROM_ELECTROMAGNETISM_HPP
 
 #include <boost/utility.hpp> // For noncopyable
+#include <vector>
 
 namespace carom
 {
@@ -48,7 +49,21 @@ namespace carom
   {
   };
 
-  class electromagnetic_force : public applied_force
+  // Forces which are the Lorentz force of an electric and a magnetic field,
+  // F = q*(E + v X B), with E and B independent of the charge's velocity.
+  // Integrators like Boris_integrator read the fields directly.
+  class field_source
+  {
+  public:
+    // field_source();
+    virtual ~field_source() { }
+
+    // Adds the fields at x to E and B
+    virtual void field(const particle& x, vector_electric_field& E,
+                       vector_magnetic_field& B) const = 0;
+  };
+
+  class electromagnetic_force : public applied_force, public field_source
   {
   public:
     electromagnetic_force(const particle& x);
@@ -60,6 +75,11 @@ namespace carom
     static void u(const scalar_permiability_constant& u);
 
     virtual vector_force force(const particle& x) const;
+    virtual bool taylor(const particle& x, const taylor_state& state,
+                        std::vector<series>& w, unsigned int k,
+                        scalar* F) const;
+    virtual void field(const particle& x, vector_electric_field& E,
+                       vector_magnetic_field& B) const;
 
   private:
     const particle* m_x;
@@ -69,25 +89,35 @@ namespace carom
     static scalar_permiability_constant  s_u;
   };
 
-  class electric_force : public applied_force
+  class electric_force : public applied_force, public field_source
   {
   public:
     electric_force(const vector_electric_field& E);
     virtual ~electric_force();
 
     virtual vector_force force(const particle& x) const;
+    virtual bool taylor(const particle& x, const taylor_state& state,
+                        std::vector<series>& w, unsigned int k,
+                        scalar* F) const;
+    virtual void field(const particle& x, vector_electric_field& E,
+                       vector_magnetic_field& B) const;
 
   private:
     vector_electric_field m_E;
   };
 
-  class magnetic_force : public applied_force
+  class magnetic_force : public applied_force, public field_source
   {
   public:
     magnetic_force(const vector_magnetic_field& B);
     virtual ~magnetic_force();
 
     virtual vector_force force(const particle& x) const;
+    virtual bool taylor(const particle& x, const taylor_state& state,
+                        std::vector<series>& w, unsigned int k,
+                        scalar* F) const;
+    virtual void field(const particle& x, vector_electric_field& E,
+                       vector_magnetic_field& B) const;
 
   private:
     vector_magnetic_field m_B;
@@ -0,0 +1,66 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_ERROR_NORM_HPP
+#define CAROM_ERROR_NORM_HPP
+
+#include <cstddef> // For size_t
+
+namespace carom
+{
+  // Measures the error of a step for adaptive integrators. The error e of
+  // each quantity is scaled by atol + rtol*|y|, with the tolerances of its
+  // kind and y its value at the start of the step, and the scaled errors are
+  // combined by their maximum or their root mean square. A value of 1 is
+  // exactly on tolerance.
+  class error_norm
+  {
+  public:
+    enum quantity { position, momentum, angle, angular_momentum };
+    enum combination { max_norm, rms_norm };
+
+    // Every atol and rtol set to tol, combined by max_norm
+    explicit error_norm(const scalar& tol);
+    // ~error_norm();
+
+    void tol(const scalar& tol);
+    void tol(quantity q, const scalar& atol, const scalar& rtol);
+
+    scalar atol(quantity q) const;
+    scalar rtol(quantity q) const;
+
+    combination method() const;
+    void method(combination method);
+
+    void clear();
+    void add(quantity q, const scalar& e, const scalar& y);
+    scalar value() const;
+
+  private:
+    scalar m_atol[4];
+    scalar m_rtol[4];
+    combination m_method;
+
+    scalar m_sum;
+    std::size_t m_count;
+    scalar m_e;
+  };
+}
+
+#endif // CAROM_ERROR_NORM_HPP
@@ -0,0 +1,85 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_EVENT_HPP
+#define CAROM_EVENT_HPP
+
+#include <boost/utility.hpp> // For noncopyable
+
+namespace carom
+{
+  // Something that happens when a function of the state of the system
+  // crosses zero, like two particles coming into contact. Integrators with a
+  // continuous extension watch for sign changes over each step and locate
+  // the crossing in the step's dense output, then call occur() with the
+  // system just past it.
+  class event : private boost::noncopyable
+  {
+  public:
+    // Which crossings count: those where value() falls, rises, or either
+    enum direction { falling, rising, either };
+
+    event(direction dir = either);
+    virtual ~event();
+
+    direction crossing() const;
+
+    virtual scalar value(const system& sys) const = 0;
+    // Responds to the event, perhaps by changing the state of the system,
+    // and returns whether the integration should stop here
+    virtual bool occur(system& sys) = 0;
+
+  private:
+    direction m_dir;
+  };
+
+  // Happens when two particles come within d of each other, stopping the
+  // integration
+  class distance_event : public event
+  {
+  public:
+    distance_event(particle& x, particle& y, const scalar_distance& d);
+    virtual ~distance_event();
+
+    virtual scalar value(const system& sys) const;
+    virtual bool occur(system& sys);
+
+  protected:
+    particle& x();
+    particle& y();
+
+  private:
+    particle* m_x;
+    particle* m_y;
+    scalar_distance m_d;
+  };
+
+  // Two spheres whose centers are x and y and whose radii add up to d, which
+  // bounce off each other elastically when they touch
+  class contact_event : public distance_event
+  {
+  public:
+    contact_event(particle& x, particle& y, const scalar_distance& d);
+    virtual ~contact_event();
+
+    virtual bool occur(system& sys);
+  };
+}
+
+#endif // CAROM_EVENT_HPP
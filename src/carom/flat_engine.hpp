@@ -0,0 +1,65 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_FLAT_ENGINE_HPP
+#define CAROM_FLAT_ENGINE_HPP
+
+#include <vector>
+
+namespace carom
+{
+  // An integrator_engine which works on one flat state vector for the whole
+  // system. Each body owns a contiguous slice of it (see body::flatten()),
+  // and every stage combination is a plain loop over the whole vector.
+  // Install it with integrator::engine(new flat_engine(sys)).
+  class flat_engine : public integrator_engine
+  {
+  public:
+    typedef flat_state::state_vector state_vector;
+
+    flat_engine(system& sys);
+    virtual ~flat_engine();
+
+    virtual void k(const a_vector& a_vecs, const scalar_time& dt);
+    virtual void y(const b_vector& b_vec);
+    virtual scalar error(const b_vector& e_vec, error_norm& norm);
+    virtual void apply();
+
+    // The state at the start of the step, and the offset of each body's slice
+    // of it. offset(sys.size()) is the length of the vector.
+    const state_vector& state() const;
+    std::size_t offset(unsigned int i) const;
+
+    // The derivative at stage i of the last step; derivative(0) is at state()
+    const state_vector& derivative(unsigned int i) const;
+
+  private:
+    flat_state m_state;
+    state_vector m_y0;
+    // The derivative at each stage; m_k[0] is the derivative at m_y0
+    std::vector<state_vector> m_k;
+    state_vector m_ytmp;
+    scalar m_dt;
+
+    // Sets r to y0 + dt*sum(b[i]*k[i])
+    void combine(state_vector& r, const b_vector& b_vec);
+  };
+}
+
+#endif // CAROM_FLAT_ENGINE_HPP
@@ -0,0 +1,115 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_FLAT_STATE_HPP
+#define CAROM_FLAT_STATE_HPP
+
+#include <vector>
+
+namespace carom
+{
+  // A system's state as one flat vector. Each body owns a contiguous slice of
+  // it (see body::flatten()), relative to the snapshot gather() last took.
+  class flat_state
+  {
+  public:
+    typedef std::vector<scalar> state_vector;
+
+    flat_state(system& sys);
+    // ~flat_state();
+
+    system& sys();
+
+    // Snapshots the bodies and flattens them into y, resizing y if bodies
+    // have gained or lost particles
+    void gather(state_vector& y);
+    // Puts the bodies in the state y
+    void scatter(const state_vector& y);
+    // Puts the bodies back in the state of the last gather() exactly
+    void restore();
+
+    // As in body; y must be the current state
+    void derivative           (const state_vector& y, state_vector& dy);
+    void coordinate_derivative(const state_vector& y, state_vector& dy);
+    void momentum_derivative  (const state_vector& y, state_vector& dy);
+    void momentum_derivative  (const state_vector& y, state_vector& dy,
+                               applied_force::timescale scale);
+
+    // Adds the error e in the state y to norm
+    void error(const state_vector& y, const state_vector& e, error_norm& norm);
+
+    // The same, for body i's slice only; the rest of dy is left alone
+    void derivative(unsigned int i, const state_vector& y, state_vector& dy);
+    void error(unsigned int i, const state_vector& y, const state_vector& e,
+               error_norm& norm);
+
+    // The offset of each body's slice; offset(sys.size()) is size()
+    std::size_t size() const;
+    std::size_t offset(unsigned int i) const;
+
+    // The pool that derivative() spreads the bodies over, or 0, the default,
+    // to go through them in order. The pool isn't owned.
+    thread_pool* threads() const;
+    void threads(thread_pool* pool);
+
+  private:
+    system* m_sys;
+    thread_pool* m_threads;
+    // The bodies, in order, as of the last gather()
+    std::vector<body*> m_bodies;
+    std::vector<y_value> m_y;
+    std::vector<std::size_t> m_offsets;
+
+    void body_derivative(const state_vector* y, state_vector* dy,
+                         std::size_t i);
+  };
+
+  // The Jacobian J of a flat_state's derivative, and the LU-factored
+  // iteration matrix I - c*J that implicit integrators solve with
+  class flat_jacobian
+  {
+  public:
+    typedef flat_state::state_vector state_vector;
+
+    flat_jacobian(flat_state& state);
+    // ~flat_jacobian();
+
+    // Finds J at y, where f is the derivative at y and the bodies are in the
+    // state y. Each body's own block comes from body::jacobian() if it can,
+    // and from finite differences otherwise, so coupling between bodies is
+    // only seen in the columns of bodies without one. That approximation is
+    // fine for simplified Newton iterations and W-methods.
+    void evaluate(state_vector& y, const state_vector& f);
+
+    // Factors I - c*J with partial pivoting
+    void factor(const scalar& c);
+    // Overwrites b with the solution of (I - c*J)x = b
+    void solve(state_vector& b) const;
+
+  private:
+    flat_state* m_state;
+    std::size_t m_n;
+    std::vector<scalar> m_J;
+    std::vector<scalar> m_LU;
+    std::vector<std::size_t> m_pivots;
+    state_vector m_f;
+  };
+}
+
+#endif // CAROM_FLAT_STATE_HPP
@@ -21,34 +21,121 @@
 #define CAROM_INTEGRATOR_HPP
 
 #include <boost/utility.hpp> // For noncopyable
+#include <tr1/memory> // For shared_ptr
+#include <deque>
 #include <vector>
 
 namespace carom
 {
+  // The stage arithmetic behind an integrator. k() evaluates the stages of a
+  // step, leaving the bodies in an unspecified state. y() then takes the
+  // step, leaving the bodies in their new state, and apply() accepts it as the
+  // start of the next step.
+  class integrator_engine : private boost::noncopyable
+  {
+  public:
+    typedef tableau::a_vector a_vector;
+    typedef tableau::b_vector b_vector;
+
+    // integrator_engine();
+    virtual ~integrator_engine();
+
+    virtual void k(const a_vector& a_vecs, const scalar_time& dt) = 0;
+    virtual void y(const b_vector& b_vec) = 0;
+    // The norm of sum(e_vec[i]*k[i]), the difference between two steps
+    virtual scalar error(const b_vector& e_vec, error_norm& norm) = 0;
+    virtual void apply() = 0;
+
+    // Gives the engine threads to spread its work over, or takes them away
+    // if pool is 0. The integrator owns the pool. Ignored by default.
+    virtual void threads(thread_pool* pool);
+  };
+
+  // The default engine, working through each body's f(), y() and step(), and
+  // its polymorphic k-values. With threads, each stage steps every body in
+  // parallel, then evaluates every f() in parallel, so no body moves while
+  // another's forces are being found.
+  class body_engine : public integrator_engine
+  {
+  public:
+    body_engine(system& sys);
+    virtual ~body_engine();
+
+    virtual void k(const a_vector& a_vecs, const scalar_time& dt);
+    virtual void y(const b_vector& b_vec);
+    virtual scalar error(const b_vector& e_vec, error_norm& norm);
+    virtual void apply();
+
+    virtual void threads(thread_pool* pool);
+
+  private:
+    typedef std::vector<std::vector<k_value> > k_vector;
+    typedef std::vector<y_value> y_vector;
+
+    system* m_sys;
+    std::vector<body*> m_bodies;
+    thread_pool* m_threads;
+    // The weights and stage that the per-body work below is doing
+    const b_vector* m_weights;
+    unsigned int m_stage;
+    scalar_time m_dt;
+    std::vector<f_value> m_f1;
+    // Snapshots of the state at the start of the step, overwritten in place by
+    // apply(). The bodies themselves hold the other buffer.
+    y_vector m_y;
+    // The k-values of the current step, one row per body
+    k_vector m_k_vecs;
+    // Scratch space for linear combinations of k-values, one per body, reused
+    // for every stage and step
+    std::vector<k_value> m_k;
+
+    // Calls f for every body, in parallel if there are threads
+    void each(void (body_engine::*f)(std::size_t));
+    void step(std::size_t j);
+    void evaluate(std::size_t j);
+    void start(std::size_t j);
+  };
+
   class integrator : private boost::noncopyable
   {
   public:
     integrator(system& sys);
     virtual ~integrator();
 
-    scalar_time integrate(const scalar_time& t, const scalar_time& dt);
+    virtual scalar_time integrate(const scalar_time& t, const scalar_time& dt);
+
+    // Replaces the engine, which defaults to a body_engine, made the first
+    // time it's needed so that integrators which never use it don't evaluate
+    // the bodies for it; the const engine() is 0 until then. Takes ownership
+    // of engine.
+    integrator_engine*       engine();
+    const integrator_engine* engine() const;
+    void engine(integrator_engine* engine);
+
+    // The number of threads the engine spreads each stage over, counting the
+    // calling one; defaults to 1
+    unsigned int threads() const;
+    void threads(unsigned int n);
 
   protected:
-    typedef std::vector<std::vector<scalar> > a_vector;
-    typedef std::vector<scalar> b_vector;
-    typedef std::vector<std::vector<k_value> > k_vector;
-    typedef std::vector<y_value> y_vector;
+    typedef tableau::a_vector a_vector;
+    typedef tableau::b_vector b_vector;
+
+    system& sys();
+    // The pool threads() made, or 0
+    thread_pool* workers();
 
-    k_vector k(const a_vector& a_vecs, const scalar_time& dt);
-    y_vector y(const b_vector& b_vec, const k_vector& k_vecs);
-    void apply(const y_vector& y_vec);
+    void k(const a_vector& a_vecs, const scalar_time& dt);
+    void y(const b_vector& b_vec);
+    scalar error(const b_vector& e_vec, error_norm& norm);
+    void apply();
 
     virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed) = 0;
 
   private:
     system* m_sys;
-    std::vector<f_value> m_f1;
-    y_vector m_y;
+    std::tr1::shared_ptr<integrator_engine> m_engine;
+    std::tr1::shared_ptr<thread_pool> m_threads;
   };
 
   class simple_integrator : public integrator
@@ -59,25 +146,126 @@ namespace carom
 
   protected:
     scalar_time simple_step(const scalar_time& dt, scalar_time& elapsed,
-                            const a_vector& a_vecs, const b_vector& b_vec);
+                            const tableau& t);
   };
 
+  // Integrators which choose their own step size, keeping the error of each
+  // step, as measured by norm(), within tolerance
   class adaptive_integrator : public integrator
   {
   public:
     adaptive_integrator(system& sys, const scalar& tol, unsigned int order);
     virtual ~adaptive_integrator();
 
+    // Starts with every tolerance set to tol
+    error_norm&       norm();
+    const error_norm& norm() const;
+
+    virtual scalar_time integrate(const scalar_time& t, const scalar_time& dt);
+    // Integrates for t, starting with initial_step()
+    scalar_time integrate(const scalar_time& t);
+
+    // With dense output, integrate() never shortens a step to land on t.
+    // It steps past t, and leaves the bodies interpolated at t; the next call
+    // carries on from the end of that step, with the step size the controller
+    // chose. The bodies and the engine mustn't be changed in between unless
+    // dense output is switched off first, which makes the interpolated state
+    // the real one. Only integrators with a continuous extension support it.
+    bool dense() const;
+    void dense(bool dense);
+
+    typedef polymorphic_list<event>::iterator event_iterator;
+
+    // Watches for e, taking ownership. integrate() then checks each event's
+    // value() for a sign change between samples() points of the dense output
+    // of every step, locates the first crossing, and calls occur() with the
+    // bodies just past it. If that returns true, integrate() returns early,
+    // and stopped() is the event. Without dense output, integrate() lands on
+    // t by interpolating rather than by shortening the last step. Only
+    // integrators with a continuous extension watch for events.
+    event_iterator watch(event* e);
+    void unwatch(event_iterator i);
+
+    // The number of intervals each step is split into; two crossings within
+    // one of them go unnoticed. Defaults to 4.
+    unsigned int samples() const;
+    void samples(unsigned int n);
+
+    // The event that stopped the last integrate(), if any, and when it
+    // happened, relative to the start of that call
+    event*      stopped() const;
+    scalar_time stopped_at() const;
+
+    // Estimates a first step size for the current state from its derivative
+    // and one more evaluation, as in Hairer, Norsett and Wanner, II.4
+    scalar_time initial_step();
+
+    // Replaces the step controller, which defaults to a PI_controller. Takes
+    // ownership of controller.
+    step_controller*       controller();
+    const step_controller* controller() const;
+    void controller(step_controller* controller);
+
   protected:
+    // Takes one step with the embeded pair t, sized for t.order(), or for the
+    // order given to the constructor if t doesn't say
     scalar_time adaptive_step(const scalar_time& dt, scalar_time& elapsed,
-                              const a_vector& a_vecs, const b_vector& b_vec,
-                              const b_vector& bstar_vec);
+                              const tableau& t);
+
+    // Decides whether to accept a step of size deltaprime with error err, and
+    // sets deltaprime to the size of the next attempt
+    bool accept(const scalar& err, scalar_time& deltaprime);
+    // The same, for integrators whose order changes from step to step
+    bool accept(const scalar& err, unsigned int order, scalar_time& deltaprime);
+
+    // Called by adaptive_step() once a step is accepted, while its stages can
+    // still be examined through error()
+    virtual void accepted(const tableau& t);
+
+    // Whether step() goes through adaptive_step() with a tableau that has a
+    // continuous extension
+    virtual bool continuous() const;
 
   private:
-    scalar m_tol;
+    error_norm m_norm;
     unsigned int m_order;
-    scalar m_err;
-    int m_steps;
+    std::tr1::shared_ptr<step_controller> m_controller;
+
+    bool m_dense;
+    // The accepted step that the bodies are interpolated within, if any: it
+    // was m_h long, and ends m_ahead after the bodies' current time
+    const tableau* m_pending;
+    scalar_time m_h;
+    scalar_time m_ahead;
+    // The size of the step after it
+    scalar_time m_next;
+    b_vector m_b;
+
+    polymorphic_list<event> m_events;
+    // The events' values at the start and end of the step being searched
+    std::vector<scalar> m_g0;
+    std::vector<scalar> m_g1;
+    unsigned int m_samples;
+    event* m_stopped;
+    scalar_time m_at;
+
+    bool watching() const;
+    void values(std::vector<scalar>& g);
+    // The value of e at theta in the pending step
+    scalar value(const event& e, const scalar& theta);
+    // Looks for the first event between theta0 and theta1 in the pending
+    // step, which ends at elapsed. If there is one, the bodies are moved to
+    // it, elapsed is updated, and the event occurs; returns whether it
+    // stopped the integration.
+    bool locate(const scalar& theta0, const scalar& theta1,
+                scalar_time& elapsed);
+    // The first crossing between theta0 and theta1, where the events' values
+    // are m_g0 and m_g1, or 0
+    event* search(const scalar& theta0, const scalar& theta1,
+                  scalar& theta);
+
+    // Takes the pending step
+    void finish();
   };
 
   class Euler_integrator : public simple_integrator
@@ -88,6 +276,9 @@ namespace carom
 
   protected:
     virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    Euler_tableau m_tableau;
   };
 
   class midpoint_integrator : public simple_integrator
@@ -98,6 +289,9 @@ namespace carom
 
   protected:
     virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    midpoint_tableau m_tableau;
   };
 
   class RK4_integrator : public simple_integrator
@@ -108,6 +302,9 @@ namespace carom
 
   protected:
     virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    RK4_tableau m_tableau;
   };
 
   class RKF45_integrator : public adaptive_integrator
@@ -118,6 +315,10 @@ namespace carom
 
   protected:
     virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+    virtual bool continuous() const;
+
+  private:
+    RKF45_tableau m_tableau;
   };
 
   class DP45_integrator : public adaptive_integrator
@@ -128,6 +329,649 @@ namespace carom
 
   protected:
     virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+    virtual bool continuous() const;
+
+  private:
+    DP45_tableau m_tableau;
+  };
+
+  // Gragg-Bulirsch-Stoer extrapolation. A step of size H takes the modified
+  // midpoint rule with n = 2, 4, 6, ... substeps, whose error is a series in
+  // (H/n)^2, and extrapolates the results to n = infinity by Aitken-Neville.
+  // Column k of the table is of order 2k, so high orders are cheap, which
+  // pays off at high precision. The number of columns and the step size are
+  // chosen together, to minimize the work per unit time, as in Hairer and
+  // Wanner's ODEX. The bodies are advanced through the flat state.
+  //
+  // The substep sequences are independent, but each evaluation puts the one
+  // set of bodies in its state, so they run one after another; with
+  // threads(), each evaluation spreads the bodies over the pool instead.
+  class Bulirsch_Stoer_integrator : public adaptive_integrator
+  {
+  public:
+    Bulirsch_Stoer_integrator(system& sys, const scalar& tol);
+    ~Bulirsch_Stoer_integrator();
+
+    // The most columns to use, at least 3. Defaults to 12.
+    unsigned int max_columns() const;
+    void max_columns(unsigned int columns);
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    typedef flat_state::state_vector state_vector;
+
+    flat_state m_state;
+    state_vector m_y0;
+    state_vector m_f;
+    // The last row of the extrapolation table
+    std::vector<state_vector> m_T;
+    // Scratch space for the midpoint rule and the extrapolation
+    state_vector m_z0;
+    state_vector m_z1;
+    state_vector m_dz;
+    state_vector m_e;
+    // The number of columns the step should converge in, give or take one
+    unsigned int m_k;
+    unsigned int m_kmax;
+
+    // Sets z to the result of the modified midpoint rule from m_y0, with n
+    // substeps of h
+    void midpoint(unsigned int n, const scalar& h, state_vector& z);
+  };
+
+  // Taylor series integration, for systems of simple_bodys whose forces can
+  // be expanded. Each step expands the state to degree order() through the
+  // forces' recurrences, then steps as far as the last two terms of the
+  // series stay within tolerance, so no step is ever rejected. The order is
+  // chosen from the tolerance as in Jorba and Zou, about 1.15 per decimal
+  // digit, which makes it far cheaper per digit than Runge-Kutta at high
+  // precision. Systems that can't be expanded are integrated with DP45.
+  class Taylor_integrator : public adaptive_integrator
+  {
+  public:
+    Taylor_integrator(system& sys, const scalar& tol);
+    ~Taylor_integrator();
+
+    unsigned int order() const;
+    void order(unsigned int order);
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    taylor_state m_state;
+    unsigned int m_degree;
+    DP45_tableau m_tableau;
+    // Whether the last step was taken by DP45, so the engine is up to date
+    bool m_fallback;
+  };
+
+  // Multirate block time stepping. Each body takes Dormand-Prince steps of
+  // its own size, dt/2^l for its level l, chosen from its own error, so a
+  // fast body doesn't drag quiescent ones down to its step size. Bodies are
+  // stepped fastest first, and bodies with the same step are stepped
+  // together. Meanwhile the bodies ahead of them are interpolated by their
+  // dense output, and the ones behind extrapolated from their last step, or
+  // from their derivative before they've taken one, so forces between
+  // bodies on very different levels are only as good as that extrapolation.
+  // Every body is synchronized at the end of each step of dt, and collisions
+  // are resolved there. The bodies are advanced through the flat state.
+  class multirate_integrator : public integrator
+  {
+  public:
+    multirate_integrator(system& sys, const scalar& tol);
+    ~multirate_integrator();
+
+    // Starts with every tolerance set to tol
+    error_norm&       norm();
+    const error_norm& norm() const;
+
+    // The most times dt may be halved, up to 30; defaults to 16. Bodies which
+    // would need still shorter steps take steps of dt/2^levels() regardless.
+    unsigned int levels() const;
+    void levels(unsigned int levels);
+
+    // The level of body i, in system order
+    unsigned int level(unsigned int i) const;
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    typedef flat_state::state_vector state_vector;
+
+    // An accepted step of one body, from tick begin to tick end, of length h;
+    // the body's slice of the state at begin, and its derivative at each
+    // stage, one slice after another
+    struct piece
+    {
+    public:
+      unsigned long begin;
+      unsigned long end;
+      scalar h;
+      state_vector y;
+      state_vector k;
+    };
+
+    flat_state m_state;
+    DP45_tableau m_tableau;
+    error_norm m_norm;
+    unsigned int m_levels;
+    // The abscissae of the tableau's stages, and the dense output weights at
+    // the end of a step
+    std::vector<scalar> m_c;
+    b_vector m_b1;
+    // The length of a tick, dt/2^levels()
+    scalar m_unit;
+
+    // Each body's level and tick, its slice of the state there, and the
+    // derivative of that slice
+    std::vector<unsigned int> m_level;
+    std::vector<unsigned long> m_tick;
+    std::vector<state_vector> m_y;
+    std::vector<state_vector> m_f;
+    // The steps each body has taken that other bodies may still look into,
+    // and its last step of the previous call, for before it has stepped in
+    // this one
+    std::vector<std::deque<piece> > m_pieces;
+    std::vector<piece> m_last;
+
+    // Scratch space: the state the bodies are scattered into, and its
+    // derivative and error
+    state_vector m_Y;
+    state_vector m_dY;
+    state_vector m_e;
+    std::vector<bool> m_active;
+    std::vector<piece> m_steps;
+    b_vector m_b;
+
+    // Gathers the bodies and finds their derivatives
+    void synchronize();
+    // Tries a step from begin to end with the bodies in group, and returns
+    // whether it was accepted
+    bool advance(const std::vector<unsigned int>& group, unsigned long begin,
+                 unsigned long end);
+    // Puts body i's state at tick t in its slice of m_Y. Past its last step,
+    // that step's dense output is extrapolated from where the body is, which
+    // may differ after a collision.
+    void position(unsigned int i, const scalar& t);
+  };
+
+  // The fourth-order Hermite predictor-corrector, for N-body systems of
+  // simple_bodys whose forces all provide their jerk. Each particle has its
+  // own block step, dt/2^l, from Aarseth's criterion with accuracy eta().
+  // At each block time every particle is predicted from its acceleration
+  // and jerk, and the ones due are corrected with their new acceleration
+  // and jerk there, so each particle's forces are evaluated once per step
+  // of its own. Particles are synchronized, and collisions resolved, every
+  // dt. Systems that can't be handled are integrated with RK4 steps of dt.
+  class Hermite_integrator : public simple_integrator
+  {
+  public:
+    Hermite_integrator(system& sys, const scalar& eta);
+    ~Hermite_integrator();
+
+    scalar eta() const;
+    void eta(const scalar& eta);
+
+    // As in multirate_integrator
+    unsigned int levels() const;
+    void levels(unsigned int levels);
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    std::vector<particle*> m_particles;
+    // Each particle's position, velocity, acceleration and jerk at its own
+    // tick, three scalars apiece, and the new acceleration and jerk of the
+    // ones being corrected
+    std::vector<scalar> m_s;
+    std::vector<scalar> m_v;
+    std::vector<scalar> m_a;
+    std::vector<scalar> m_j;
+    std::vector<scalar> m_a1;
+    std::vector<scalar> m_j1;
+    std::vector<unsigned long> m_tick;
+    std::vector<unsigned int> m_level;
+    // The step each particle asked for at its last correction
+    std::vector<scalar> m_step;
+
+    scalar m_eta;
+    unsigned int m_levels;
+    RK4_tableau m_tableau;
+    // Whether the last step was taken by RK4, so the engine is up to date
+    bool m_fallback;
+
+    // Collects the particles and their accelerations and jerks, and returns
+    // false if the system can't be integrated this way
+    bool start(const scalar& dt);
+    // Puts particle i's acceleration and jerk in a and j
+    bool evaluate(unsigned int i, std::vector<scalar>& a,
+                  std::vector<scalar>& j);
+    // Moves particle i to its predicted state h after its own tick
+    void predict(unsigned int i, const scalar& h);
+    // Corrects particle i after a step of h, and returns the step it asks for
+    scalar correct(unsigned int i, const scalar& h);
+  };
+
+  // Wisdom-Holman mapping in democratic heliocentric coordinates, for systems
+  // of simple_bodys dominated by one central mass, the heaviest particle.
+  // The motion of each particle about it under its gravitational_force is
+  // propagated analytically, by Kepler's equation in universal variables,
+  // so steps need only resolve the particles' other forces, which are
+  // applied as kicks. The central particle's own forces are taken to be the
+  // pull of the others, and the step is symplectic when every force depends
+  // only on position. Other systems are integrated with RK4.
+  class Wisdom_Holman_integrator : public simple_integrator
+  {
+  public:
+    Wisdom_Holman_integrator(system& sys);
+    ~Wisdom_Holman_integrator();
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    std::vector<particle*> m_particles;
+    unsigned int m_central;
+    // Whether each particle orbits the central one
+    std::vector<bool> m_orbits;
+    // Heliocentric positions and barycentric momenta, three scalars per
+    // particle, with the central particle's entries holding the center of
+    // mass and the total momentum
+    std::vector<scalar> m_Q;
+    std::vector<scalar> m_P;
+    std::vector<scalar> m_m;
+    scalar m_M;
+    // The kicks at the current positions, and whether they're still valid
+    std::vector<scalar> m_F;
+    bool m_forces;
+
+    RK4_tableau m_tableau;
+    // Whether the last step was taken by RK4, so the engine is up to date
+    bool m_fallback;
+
+    // Collects the particles into m_Q and m_P, and returns false if the
+    // system can't be integrated this way
+    bool start();
+    // Puts the particles in the state m_Q and m_P
+    void finish();
+
+    void kick (const scalar& h);
+    // Moves the particles by the central particle's reflex motion
+    void jump (const scalar& h);
+    void drift(const scalar& h);
+  };
+
+  // The Boris pusher for charged particles. The forces which are fields
+  // (field_source) are read as E and B at the midpoint of each step, and the
+  // velocity is advanced by half an electric kick, an exact-magnitude
+  // rotation about B, and another half kick, so pure gyration conserves
+  // energy for any step size. Other forces are added to the kicks. Only
+  // simple_bodys are pushed this way; other systems fall back to RK4.
+  class Boris_integrator : public simple_integrator
+  {
+  public:
+    Boris_integrator(system& sys);
+    ~Boris_integrator();
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    std::vector<particle*> m_particles;
+    // Positions, velocities, and the fields and other forces at the
+    // midpoint, three scalars per particle
+    std::vector<scalar> m_s;
+    std::vector<scalar> m_v;
+    std::vector<scalar> m_E;
+    std::vector<scalar> m_B;
+    std::vector<scalar> m_F;
+    std::vector<scalar> m_q;
+    std::vector<scalar> m_m;
+
+    RK4_tableau m_tableau;
+    // Whether the last step was taken by RK4, so the engine is up to date
+    bool m_fallback;
+
+    // Collects the particles, and returns false if the system can't be
+    // integrated this way
+    bool start();
+    // Puts the particles in the state m_s and m_v
+    void finish();
+
+    void drift(const scalar& h);
+    // Evaluates m_E, m_B and m_F with the particles at m_s
+    void evaluate();
+    void push(const scalar& h);
+  };
+
+  // Splits the system into close pairs and the rest. A pair of mutually
+  // gravitating particles is regularized when its dynamical time
+  // sqrt(r^3/(G*M)) is shorter than eta() steps. A step kicks the single
+  // particles and the pairs' centers of mass with every force but the
+  // pairs' mutual gravity, and drifts them, while each pair's relative orbit
+  // is advanced in Kustaanheimo-Stiefel coordinates, where a close approach
+  // is no harder than any other part of the orbit, in substeps which kick it
+  // with the tidal field of the rest. Systems that aren't all simple_bodys
+  // fall back to RK4.
+  class KS_integrator : public simple_integrator
+  {
+  public:
+    KS_integrator(system& sys);
+    ~KS_integrator();
+
+    scalar eta() const;
+    void eta(const scalar& eta);
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    std::vector<particle*> m_particles;
+    // The particle each one is paired with, or itself
+    std::vector<unsigned int> m_partner;
+    // Positions, velocities, and kicks, three scalars per particle
+    std::vector<scalar> m_s;
+    std::vector<scalar> m_v;
+    std::vector<scalar> m_m;
+    std::vector<scalar> m_F;
+    // Whether m_F is still valid
+    bool m_forces;
+    scalar m_eta;
+
+    RK4_tableau m_tableau;
+    // Whether the last step was taken by RK4, so the engine is up to date
+    bool m_fallback;
+
+    // Collects the particles and pairs them, and returns false if the
+    // system can't be integrated this way
+    bool start(const scalar& h);
+    // Puts the particles in the state m_s and m_v
+    void finish();
+
+    void kick (const scalar& h);
+    void drift(const scalar& h);
+    // Advances the pairs' relative orbits
+    void orbit(const scalar& h);
+
+    // The force on particle i, but for its partner's gravity
+    void force(unsigned int i, scalar* F);
+    // The relative acceleration of particle i's pair, with center of mass R
+    // and V and relative position r and v, from every force but their
+    // mutual gravity
+    void perturbation(unsigned int i, const scalar* R, const scalar* V,
+                      const scalar* r, const scalar* v, scalar* P);
+
+    // Whether x feels y's gravity
+    static bool attracts(const particle& x, const particle& y);
+  };
+
+  // Sets c[0..3] to the Stumpff functions c[k](z) = sum((-z)^n/(2n + k)!)
+  void stumpff(const scalar& z, scalar* c);
+
+  // Advances the position r and velocity v along a Kepler orbit about a mass
+  // with gravitational parameter mu, for a time h
+  void kepler(scalar* r, scalar* v, const scalar& mu, const scalar& h);
+
+  // Like kepler(), but through the Kustaanheimo-Stiefel transformation,
+  // where the orbit is a harmonic oscillation in the fictitious time s,
+  // dt = r*ds, which stays regular through collision
+  void KS_kepler(scalar* r, scalar* v, const scalar& mu, const scalar& h);
+
+  // Splitting methods for systems whose forces depend only on position. A
+  // step alternates kicks, which advance the momenta at fixed coordinates,
+  // with drifts, which advance the coordinates at fixed momenta, so the step
+  // is symplectic and time-reversible and the energy error stays bounded.
+  // Only kicks evaluate forces, once per substep, and the last one is reused
+  // by the next step. The bodies are advanced through the flat state.
+  class symplectic_integrator : public integrator
+  {
+  public:
+    virtual ~symplectic_integrator();
+
+    unsigned int order() const;
+
+  protected:
+    // A composition of velocity Verlet substeps, or of leapfrog substeps if
+    // drift_first is set, of the given even order. Odd orders are rounded up.
+    symplectic_integrator(system& sys, unsigned int order, bool drift_first);
+
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    typedef flat_state::state_vector state_vector;
+
+    flat_state m_state;
+    state_vector m_y;
+    state_vector m_dy;
+    // Whether m_dy holds the momentum derivative at m_y
+    bool m_forces;
+
+    // The coefficients of alternating kicks and drifts
+    std::vector<scalar> m_c;
+    bool m_drift_first;
+    unsigned int m_order;
+
+    void kick (const scalar& h);
+    void drift(const scalar& h);
+  };
+
+  // Kick-drift-kick
+  class velocity_Verlet_integrator : public symplectic_integrator
+  {
+  public:
+    velocity_Verlet_integrator(system& sys);
+    ~velocity_Verlet_integrator();
+  };
+
+  // Drift-kick-drift
+  class leapfrog_integrator : public symplectic_integrator
+  {
+  public:
+    leapfrog_integrator(system& sys);
+    ~leapfrog_integrator();
+  };
+
+  // Three velocity Verlet substeps, fourth order
+  class Forest_Ruth_integrator : public symplectic_integrator
+  {
+  public:
+    Forest_Ruth_integrator(system& sys);
+    ~Forest_Ruth_integrator();
+  };
+
+  // Yoshida's triple-jump composition of velocity Verlet to any even order;
+  // 3^(order/2 - 1) substeps
+  class Yoshida_integrator : public symplectic_integrator
+  {
+  public:
+    Yoshida_integrator(system& sys, unsigned int order);
+    ~Yoshida_integrator();
+  };
+
+  // Reversible RESPA, multiple time stepping by force timescale. A step of dt
+  // kicks with the slow forces for dt/2, takes substeps() velocity Verlet
+  // substeps under the fast forces alone, then kicks with the slow forces
+  // for dt/2 again. So the slow forces are evaluated once per step and the
+  // fast ones once per substep, and the step is still symplectic and
+  // time-reversible for forces which depend only on position. dt should
+  // resolve the slow forces, and dt/substeps() the fast ones.
+  class RESPA_integrator : public integrator
+  {
+  public:
+    RESPA_integrator(system& sys, unsigned int substeps);
+    ~RESPA_integrator();
+
+    unsigned int substeps() const;
+    void substeps(unsigned int substeps);
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    typedef flat_state::state_vector state_vector;
+
+    flat_state m_state;
+    state_vector m_y;
+    state_vector m_dy;
+    // The momentum derivatives due to each timescale's forces, and whether
+    // they're still valid at m_y
+    state_vector m_fast;
+    state_vector m_slow;
+    bool m_fast_forces;
+    bool m_slow_forces;
+    unsigned int m_substeps;
+
+    void kick (const scalar& h, applied_force::timescale scale);
+    void drift(const scalar& h);
+  };
+
+  // Integrators for stiff systems, which solve z = y0 + theta*h*f(z) each step
+  // by simplified Newton iteration on the flat state, then take
+  // y1 = y0 + (z - y0)/theta. The factored Jacobian is kept across steps
+  // until the iteration stops converging. With a working_precision(), the
+  // Jacobian and the iteration are done at that precision, and the solution is
+  // then refined by the same iteration with residuals at full precision.
+  //
+  // If the iteration or the refinement doesn't converge even with a fresh
+  // Jacobian, the step is halved and tried again, up to ten times; step()
+  // returns dt regardless, so the next step tries the full size again.
+  class implicit_integrator : public integrator
+  {
+  public:
+    virtual ~implicit_integrator();
+
+    // The tolerance of the Newton iteration, relative to the size of each
+    // component. Defaults to sqrt(epsilon).
+    scalar tol() const;
+    void tol(const scalar& tol);
+
+    // The precision, in bits, that the Jacobian is evaluated and factored at
+    // and the iteration run at; 0, the default, means precision(). The
+    // solution is then refined at precision(), so the step's accuracy doesn't
+    // depend on it, as long as the iteration still converges.
+    unsigned long working_precision() const;
+    void working_precision(unsigned long bits);
+
+    // Whether the last step converged. If not, even its smallest attempt was
+    // taken as it stood, and the state is only approximate.
+    bool converged() const;
+
+  protected:
+    implicit_integrator(system& sys, const scalar& theta);
+
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    typedef flat_state::state_vector state_vector;
+
+    flat_state m_state;
+    flat_jacobian m_J;
+    // The state at the start of the step and its derivative
+    state_vector m_y0;
+    state_vector m_f;
+    state_vector m_z;
+    state_vector m_dz;
+    // y0 at the working precision
+    state_vector m_yw;
+    scalar m_theta;
+    scalar m_tol;
+    // The theta*h that m_J is factored for, if m_jacobian is set
+    scalar m_c;
+    bool m_jacobian;
+    bool m_converged;
+    unsigned long m_working;
+
+    // Finds z for the step theta*h = c into m_z, from the state y0, which the
+    // bodies must be in; false if it couldn't
+    bool solve(const scalar& c);
+    // Iterates from the predictor, or from m_z as it is, until the updates
+    // are within tol
+    bool newton(const scalar& c, const scalar& tol, bool predict);
+  };
+
+  // Theta = 1; L-stable, first order
+  class backward_Euler_integrator : public implicit_integrator
+  {
+  public:
+    backward_Euler_integrator(system& sys);
+    ~backward_Euler_integrator();
+  };
+
+  // Theta = 1/2; A-stable, symplectic, second order
+  class implicit_midpoint_integrator : public implicit_integrator
+  {
+  public:
+    implicit_midpoint_integrator(system& sys);
+    ~implicit_midpoint_integrator();
+  };
+
+  // ROS2, the second-order L-stable Rosenbrock-W method of Verwer et al., with
+  // an embedded first-order error estimate. Each stage is one linear solve,
+  // with no Newton iteration. As a W-method it keeps its order with any
+  // approximation to the Jacobian, so the Jacobian is only re-evaluated after
+  // a rejected step.
+  class ROS2_integrator : public adaptive_integrator
+  {
+  public:
+    ROS2_integrator(system& sys, const scalar& tol);
+    ~ROS2_integrator();
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+    // Starts again from the bodies' current state, with a new Jacobian
+    void restart();
+
+    // h times the magnitude of the dominant eigenvalue, as estimated from
+    // the last step by |f(y0 + h*k1) - f(y0)|/|k1|
+    const scalar& stiffness() const;
+
+  private:
+    typedef flat_state::state_vector state_vector;
+
+    flat_state m_state;
+    flat_jacobian m_J;
+    state_vector m_y0;
+    state_vector m_f;
+    state_vector m_k1;
+    state_vector m_k2;
+    state_vector m_y;
+    scalar m_gamma;
+    scalar m_stiffness;
+    bool m_jacobian;
+  };
+
+  // DP45 while the system is not stiff, and ROS2 while it is. Once h times
+  // the dominant eigenvalue passes 3.25, the DP45 step is limited by
+  // stability rather than accuracy. Hairer's DOPRI5 estimates it from
+  // |f(Y7) - f(Y6)|/|Y7 - Y6|, but for an undamped oscillation that ratio
+  // depends on the phase. Instead the DP45 stages are solved for (hJ)^k*f(y0),
+  // and sqrt(|(hJ)^6*f|/|(hJ)^4*f|) is the estimate. Switching either way
+  // needs 15 steps in a row to agree. The DP45 steps run on a flat_engine, so
+  // that the stages are whole states; with any other engine it never switches
+  // to ROS2.
+  class stiffness_switching_integrator : public ROS2_integrator
+  {
+  public:
+    stiffness_switching_integrator(system& sys, const scalar& tol);
+    ~stiffness_switching_integrator();
+
+    bool stiff() const;
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+    virtual void accepted(const tableau& t);
+
+  private:
+    DP45_tableau m_tableau;
+    bool m_stiff;
+    // The number of steps in a row that suggest switching
+    unsigned int m_count;
   };
 }
 
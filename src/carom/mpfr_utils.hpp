@@ -31,6 +31,18 @@ namespace carom
   inline void precision(unsigned long prec) { mpfr_set_default_prec(prec); }
   inline unsigned long precision() { return mpfr_get_default_prec(); }
 
+  // Sets the precision for as long as it exists, then restores the old one
+  class scoped_precision : private boost::noncopyable
+  {
+  public:
+    explicit scoped_precision(unsigned long prec) : m_prec(precision())
+    { precision(prec); }
+    ~scoped_precision() { precision(m_prec); }
+
+  private:
+    unsigned long m_prec;
+  };
+
   class optimization;
 
   extern boost::thread_specific_ptr<optimization>* pool_ptr;
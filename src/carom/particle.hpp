@@ -21,18 +21,49 @@
 #define CAROM_PARTICLE_HPP
 
 #include <boost/utility.hpp> // For noncopyable
+#include <vector>
 
 namespace carom
 {
   class particle;
+  class taylor_state;
 
   class applied_force : private boost::noncopyable
   {
   public:
-    // applied_force();
+    // How quickly a force varies, for multiple time stepping integrators,
+    // which evaluate slow forces less often than fast ones
+    enum timescale { fast, slow };
+
+    applied_force() : m_scale(fast) { }
     virtual ~applied_force() { }
 
+    // Defaults to fast, unless the force says otherwise
+    timescale scale() const { return m_scale; }
+    void scale(timescale scale) { m_scale = scale; }
+
     virtual vector_force force(const particle& x) const = 0;
+
+    // Adds the derivative of force(x) with respect to x's position to the 3x3
+    // matrix J, row by row, for implicit integrators. Forces which depend on
+    // anything else return false.
+    virtual bool jacobian(const particle& x, scalar* J) const { return false; }
+
+    // Adds the time derivative of force(x), given the current positions and
+    // velocities, to the three scalars dF, for Hermite integrators. Forces
+    // which can't return false.
+    virtual bool jerk(const particle& x, scalar* dF) const { return false; }
+
+    // Adds coefficient k of the Taylor series of force(x) to F, for Taylor
+    // integrators, given coefficients 0..k of every particle's position and
+    // momentum in state. w is this force's own space for intermediate series,
+    // kept from one coefficient to the next. Forces which can't return false.
+    virtual bool taylor(const particle& x, const taylor_state& state,
+                        std::vector<series>& w, unsigned int k,
+                        scalar* F) const { return false; }
+
+  private:
+    timescale m_scale;
   };
 
   class particle : private boost::noncopyable
@@ -58,6 +89,9 @@ namespace carom
     void a(const vector_acceleration& a);
     void F(const vector_force& F);
 
+    // Copies the mass, position, and momentum of x, without temporaries
+    void assign(const particle& x);
+
     iterator apply_force(applied_force* force);
     void remove_force(iterator i);
 
@@ -69,6 +103,15 @@ namespace carom
     std::size_t size() const;
 
     void apply_forces();
+    // Sets F() to the sum of the forces on one timescale only
+    void apply_forces(applied_force::timescale scale);
+
+    // Adds the derivative of F() with respect to position to J; false unless
+    // every force provides one
+    bool jacobian(scalar* J) const;
+    // Adds the time derivative of F() to dF; false unless every force
+    // provides one
+    bool jerk(scalar* dF) const;
 
   private:
     scalar_mass         m_mass;
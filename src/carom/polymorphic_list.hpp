@@ -166,7 +166,7 @@ namespace carom
     const_reverse_iterator rend() const 
     { return const_reverse_iterator(begin()); }
 
-    bool empty() { return m_list.next == &m_end; }
+    bool empty() const { return m_list.next == &m_end; }
     size_type size() const { return std::distance(begin(), end()); }
 
     reference       front()       { return *m_list.next->data; }
@@ -70,6 +70,13 @@ namespace carom
     virtual k_base* multiply(const scalar& n) const;
     virtual k_base* divide  (const scalar& n) const;
 
+    virtual void axpy(const std::vector<scalar>& a,
+                      const std::vector<k_value>& k);
+    virtual k_base* clone() const;
+
+    virtual void error(const body& y0, const scalar_time& dt,
+                       error_norm& norm) const;
+
   private:
     scalar_time             m_dt;
     vector_momentum         m_dp;
@@ -79,6 +86,8 @@ namespace carom
   class rigid_body : public body
   {
   public:
+    typedef rigid_k_base k_type;
+
     // rigid_body();
     // virtual ~rigid_body();
 
@@ -101,9 +110,33 @@ namespace carom
     virtual scalar_mass mass(const particle& x) const;
     virtual void collision(particle& x, const vector_momentum& dp);
 
+    using body::y;
     virtual f_value f();
     virtual y_value y();
     virtual void step(const y_value& y0, const k_value& k);
+
+    // Non-virtual versions of f() and step(), for typed_engine. k() sets k to
+    // dt*f() in place.
+    void k(const scalar_time& dt, rigid_k_base& k);
+    void step(const rigid_body& y0, const rigid_k_base& k);
+
+    virtual std::size_t dimension() const;
+    virtual void flatten(const y_value& y0, scalar* y) const;
+    virtual void unflatten(const y_value& y0, const scalar* y);
+    virtual void coordinate_derivative(const scalar* y, scalar* dy);
+    virtual void force_derivative(const scalar* y, scalar* dy);
+    virtual void error(const scalar* y, const scalar* e,
+                       error_norm& norm) const;
+
+  private:
+    // The terms of the sums above, for particle x
+    static scalar_moment_of_inertia
+    moment_of_inertia_of(const particle& x, const vector_displacement& o,
+                         const vector& axis);
+    static vector_angular_momentum
+    angular_momentum_of(const particle& x, const vector_displacement& o);
+    static vector_torque torque_of(const particle& x,
+                                   const vector_displacement& o);
   };
 
   template <>
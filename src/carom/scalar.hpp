@@ -113,6 +113,14 @@ namespace carom
       return *this;
     }
 
+    // Fused *this += a*n, with a single rounding and no temporaries
+    scalar_units& addmul(const scalar_units<0, 0, 0>& a,
+                         const scalar_units<m, d, t>& n) {
+      update_precision();
+      mpfr_fma(m_fp, a.mpfr(), n.m_fp, m_fp, GMP_RNDN);
+      return *this;
+    }
+
     mpfr_ptr mpfr() const { return m_fp; }
 
     template <typename T> T to() const { return mpfr_to<T>(m_fp); }
@@ -284,6 +292,15 @@ namespace carom
     return r;
   }
 
+  // Disambiguate the scalar_units<0, 0, 0> - scalar_units<0, 0, 0> case
+  inline scalar_units<0, 0, 0>
+  operator-(const scalar_units<0, 0, 0>& lhs,
+            const scalar_units<0, 0, 0>& rhs) {
+    scalar_units<0, 0, 0> r;
+    mpfr_sub(r.mpfr(), lhs.mpfr(), rhs.mpfr(), GMP_RNDN);
+    return r;
+  }
+
   template <int m1, int d1, int t1, int m2, int d2, int t2>
   inline scalar_units<m1 + m2, d1 + d2, t1 + t2>
   operator*(const scalar_units<m1, d1, t1>& lhs,
@@ -0,0 +1,69 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_SERIES_HPP
+#define CAROM_SERIES_HPP
+
+#include <vector>
+
+namespace carom
+{
+  // A truncated power series in the time since some t0,
+  // x(t0 + h) = x[0] + x[1]*h + x[2]*h^2 + ..., with unitless coefficients.
+  // Taylor integrators find the coefficients one degree at a time, so each
+  // function below sets coefficient k of its result r from the coefficients
+  // up to k of its arguments, which must already be known. A whole series of
+  // degree n then costs O(n^2).
+  class series
+  {
+  public:
+    series();
+    // series(const series& x);
+    // ~series();
+
+    // series& operator=(const series& x);
+
+    // The non-const version grows the series to hold x[k] if need be
+    scalar&       operator[](unsigned int k);
+    const scalar& operator[](unsigned int k) const;
+
+    // The number of coefficients; new ones are zero
+    std::size_t size() const;
+    void resize(std::size_t n);
+
+    // x(t0 + h), by Horner's rule
+    scalar operator()(const scalar& h) const;
+
+  private:
+    std::vector<scalar> m_coeffs;
+  };
+
+  // r = a + b, a - b, a*b, a/b, and a^e for a[0] > 0
+  void add     (series& r, const series& a, const series& b, unsigned int k);
+  void subtract(series& r, const series& a, const series& b, unsigned int k);
+  void multiply(series& r, const series& a, const series& b, unsigned int k);
+  void divide  (series& r, const series& a, const series& b, unsigned int k);
+  void pow     (series& r, const series& a, const scalar& e, unsigned int k);
+
+  // Vectors of three series; r = a.b and r = a X b
+  void dot  (series& r, const series* a, const series* b, unsigned int k);
+  void cross(series* r, const series* a, const series* b, unsigned int k);
+}
+
+#endif // CAROM_SERIES_HPP
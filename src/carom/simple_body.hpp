@@ -72,6 +72,13 @@ namespace carom
     virtual k_base* multiply(const scalar& n) const;
     virtual k_base* divide  (const scalar& n) const;
 
+    virtual void axpy(const std::vector<scalar>& a,
+                      const std::vector<k_value>& k);
+    virtual k_base* clone() const;
+
+    virtual void error(const body& y0, const scalar_time& dt,
+                       error_norm& norm) const;
+
   private:
     scalar_time m_dt;
     std::vector<vector_momentum> m_momenta;
@@ -80,6 +87,8 @@ namespace carom
   class simple_body : public body
   {
   public:
+    typedef simple_k_base k_type;
+
     // simple_body();
     // virtual ~simple_body();
 
@@ -87,9 +96,30 @@ namespace carom
     virtual scalar_mass mass(const particle& x) const;
     virtual void collision(particle& x, const vector_momentum& dp);
 
+    using body::y;
     virtual f_value f();
     virtual y_value y();
     virtual void step(const y_value& y0, const k_value& k);
+
+    // Non-virtual versions of f() and step(), for typed_engine. k() sets k to
+    // dt*f() in place.
+    void k(const scalar_time& dt, simple_k_base& k);
+    void step(const body& y0, const simple_k_base& k);
+
+    virtual std::size_t dimension() const;
+    virtual void flatten(const y_value& y0, scalar* y) const;
+    virtual void unflatten(const y_value& y0, const scalar* y);
+    virtual void coordinate_derivative(const scalar* y, scalar* dy);
+    virtual void force_derivative(const scalar* y, scalar* dy);
+    virtual bool jacobian(const scalar* y, scalar* J, std::size_t stride);
+
+  private:
+    // The loop bodies of the above, for particle i
+    void f_at(simple_f_base* r, std::size_t i) const;
+    void k_at(simple_k_base* k, std::size_t i) const;
+    void step_at(const body* y0, const simple_k_base* k, std::size_t i);
+    void velocity_at(scalar* dy, std::size_t i) const;
+    void force_at(scalar* dy, std::size_t i) const;
   };
 }
 
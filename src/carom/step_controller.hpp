@@ -0,0 +1,116 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_STEP_CONTROLLER_HPP
+#define CAROM_STEP_CONTROLLER_HPP
+
+#include <boost/utility.hpp> // For noncopyable
+
+namespace carom
+{
+  // Chooses step sizes for adaptive integrators. control() is given the error
+  // of a step of size dt, scaled so that the tolerance is 1, and the order of
+  // the error estimate. It decides whether to accept the step, and sets dt to
+  // the size of the next attempt: dt times safety()*factor(), limited to
+  // [min_factor(), max_factor()]. After a rejection, the step never grows.
+  class step_controller : private boost::noncopyable
+  {
+  public:
+    virtual ~step_controller();
+
+    bool control(const scalar& err, unsigned int order, scalar_time& dt);
+
+    scalar safety() const;
+    void safety(const scalar& safety);
+
+    scalar min_factor() const;
+    void min_factor(const scalar& min);
+
+    scalar max_factor() const;
+    void max_factor(const scalar& max);
+
+    // The number of steps accepted and rejected so far
+    unsigned long accepted() const;
+    unsigned long rejected() const;
+
+    // Forgets the errors of past steps, but not the counts
+    virtual void reset();
+
+  protected:
+    step_controller();
+
+    // The factor to change the step by, before the safety factor and limits,
+    // given err and k = order + 1
+    virtual scalar factor(const scalar& err, const scalar& k) const = 0;
+    // Called with the error of each accepted step
+    virtual void remember(const scalar& err);
+
+  private:
+    scalar m_safety;
+    scalar m_min;
+    scalar m_max;
+    unsigned long m_accepted;
+    unsigned long m_rejected;
+  };
+
+  // Soederlind's PID form, with h[n+1] = h[n]*e[n]^-(kI + kP + kD)/k
+  //                                         *e[n-1]^(kP + 2*kD)/k
+  //                                         *e[n-2]^-kD/k,
+  // where e[n-1] and e[n-2] are the errors of the last two accepted steps
+  class PID_controller : public step_controller
+  {
+  public:
+    // The gains of Gustafsson's PI controller, with some derivative action
+    PID_controller();
+    PID_controller(const scalar& kI, const scalar& kP, const scalar& kD);
+    virtual ~PID_controller();
+
+    virtual void reset();
+
+  protected:
+    virtual scalar factor(const scalar& err, const scalar& k) const;
+    virtual void remember(const scalar& err);
+
+  private:
+    scalar m_kI;
+    scalar m_kP;
+    scalar m_kD;
+    scalar m_err1;
+    scalar m_err2;
+  };
+
+  // Gustafsson's PI controller, kI = 0.3, kP = 0.4
+  class PI_controller : public PID_controller
+  {
+  public:
+    PI_controller();
+    PI_controller(const scalar& kI, const scalar& kP);
+    ~PI_controller();
+  };
+
+  // The classical controller, h[n+1] = h[n]*e[n]^(-1/k)
+  class I_controller : public PID_controller
+  {
+  public:
+    I_controller();
+    ~I_controller();
+  };
+}
+
+#endif // CAROM_STEP_CONTROLLER_HPP
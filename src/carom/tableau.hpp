@@ -0,0 +1,111 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_TABLEAU_HPP
+#define CAROM_TABLEAU_HPP
+
+#include <vector>
+
+namespace carom
+{
+  // A Butcher tableau, describing an explicit Runge-Kutta method. a() holds
+  // the rows of the strictly lower-triangular part of the a-value matrix,
+  // starting from the second row. bstar() holds the weights of the embeded
+  // method, and is empty if there isn't one.
+  //
+  // Some methods also have a continuous extension, for dense output: weights
+  // b[i](theta), polynomials in theta with b[i](1) == b()[i], such that
+  // y + sum(b[i](theta)*k[i]) approximates the solution at t + theta*dt.
+  class tableau
+  {
+  public:
+    typedef std::vector<std::vector<scalar> > a_vector;
+    typedef std::vector<scalar> b_vector;
+
+    // tableau(const tableau& t);
+    virtual ~tableau();
+
+    // tableau& operator=(const tableau& t);
+
+    const a_vector& a() const;
+    const b_vector& b() const;
+    const b_vector& bstar() const;
+
+    std::size_t stages() const;
+    bool embedded() const;
+
+    // The order of the method, or for embeded pairs, of the lower-order one
+    unsigned int order() const;
+
+    // Whether there is a continuous extension, and its weights at theta
+    bool dense() const;
+    void dense(const scalar& theta, b_vector& b) const;
+
+  protected:
+    tableau();
+
+    // Helpers for derrived classes' constructors
+    void order(unsigned int order);
+    void row(const scalar* a, std::size_t n);
+    void b(const scalar* b, std::size_t n);
+    void bstar(const scalar* bstar, std::size_t n);
+    // Adds the coefficients of the next stage's b[i](theta)/theta, starting
+    // from the constant term
+    void dense(const scalar* d, std::size_t n);
+
+  private:
+    a_vector m_a;
+    b_vector m_b;
+    b_vector m_bstar;
+    a_vector m_dense;
+    unsigned int m_order;
+  };
+
+  class Euler_tableau : public tableau
+  {
+  public:
+    Euler_tableau();
+  };
+
+  class midpoint_tableau : public tableau
+  {
+  public:
+    midpoint_tableau();
+  };
+
+  class RK4_tableau : public tableau
+  {
+  public:
+    RK4_tableau();
+  };
+
+  class RKF45_tableau : public tableau
+  {
+  public:
+    RKF45_tableau();
+  };
+
+  class DP45_tableau : public tableau
+  {
+  public:
+    DP45_tableau();
+  };
+}
+
+#endif // CAROM_TABLEAU_HPP
@@ -0,0 +1,68 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_TAYLOR_STATE_HPP
+#define CAROM_TAYLOR_STATE_HPP
+
+#include <boost/utility.hpp> // For noncopyable
+#include <map>
+#include <vector>
+
+namespace carom
+{
+  // The Taylor expansion of a system of simple_bodys about its current state:
+  // series for the position and momentum of every particle, found from
+  // s' = p/m and from the forces' own Taylor coefficients (see
+  // applied_force::taylor())
+  class taylor_state : private boost::noncopyable
+  {
+  public:
+    taylor_state(system& sys);
+    // ~taylor_state();
+
+    system& sys();
+
+    // Expands the bodies' current state to degree n. Fails if a body isn't a
+    // simple_body, or a force can't be expanded.
+    bool expand(unsigned int n);
+
+    // x's position and momentum, three series each, or 0 if x isn't in the
+    // system
+    const series* s(const particle& x) const;
+    const series* p(const particle& x) const;
+
+    // Adds the size of coefficient k of each position and momentum to norm,
+    // relative to the current values
+    void error(unsigned int k, error_norm& norm) const;
+
+    // Moves the bodies along the series, to t0 + h
+    void evaluate(const scalar& h);
+
+  private:
+    system* m_sys;
+    std::vector<particle*> m_particles;
+    std::map<const particle*, std::size_t> m_index;
+    // Six series per particle: position, then momentum
+    std::vector<std::vector<series> > m_series;
+    // The space of each force on each particle, in order
+    std::vector<std::vector<series> > m_work;
+  };
+}
+
+#endif // CAROM_TAYLOR_STATE_HPP
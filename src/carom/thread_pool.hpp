@@ -0,0 +1,83 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_THREAD_POOL_HPP
+#define CAROM_THREAD_POOL_HPP
+
+#include <boost/utility.hpp> // For noncopyable
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_array.hpp>
+#include <cstddef> // For size_t
+
+namespace carom
+{
+  // A fixed set of worker threads for loops whose iterations are
+  // independent. run() deals each thread a contiguous share of the loop, and
+  // threads that run out steal half of what's left of another's share. Each
+  // worker has its own optimization pool, and works at the precision of the
+  // thread that called run().
+  class thread_pool : private boost::noncopyable
+  {
+  public:
+    typedef boost::function<void (std::size_t)> task;
+
+    // n threads in all, counting the one that calls run()
+    explicit thread_pool(unsigned int n);
+    ~thread_pool();
+
+    unsigned int size() const;
+
+    // Calls f(i) for every i in [0, n), and returns once they're all done.
+    // Calls made while the pool is busy, as from inside f, run serially on
+    // the calling thread.
+    void run(std::size_t n, const task& f);
+
+  private:
+    struct range
+    {
+      boost::mutex mutex;
+      std::size_t begin;
+      std::size_t end;
+    };
+
+    unsigned int m_size;
+    boost::scoped_array<range> m_ranges;
+    boost::thread_group m_threads;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_start;
+    boost::condition_variable m_done;
+    // Bumped for each run()
+    unsigned long m_generation;
+    // The number of workers still busy with it
+    unsigned int m_busy;
+    bool m_running;
+    bool m_stop;
+    const task* m_task;
+    unsigned long m_precision;
+
+    void main(unsigned int id);
+    // Runs thread id's share, then whatever it can steal
+    void work(unsigned int id);
+    bool steal(unsigned int id);
+  };
+}
+
+#endif // CAROM_THREAD_POOL_HPP
@@ -0,0 +1,241 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#ifndef CAROM_TYPED_ENGINE_HPP
+#define CAROM_TYPED_ENGINE_HPP
+
+#include <algorithm> // For max()
+#include <typeinfo> // For typeid
+#include <vector>
+
+namespace carom
+{
+  // An integrator_engine for systems made up only of bodies of type Body (or
+  // impenetrable_body<Body>), which must provide the non-virtual k() and
+  // step() of simple_body and rigid_body. Every per-body call is resolved at
+  // compile time, no k-values are allocated after the first step, and no
+  // dynamic_cast's are made.
+  template <typename Body>
+  class typed_engine : public integrator_engine
+  {
+  public:
+    typedef typename Body::k_type k_type;
+
+    typed_engine(system& sys);
+    virtual ~typed_engine();
+
+    virtual void k(const a_vector& a_vecs, const scalar_time& dt);
+    virtual void y(const b_vector& b_vec);
+    virtual scalar error(const b_vector& e_vec, error_norm& norm);
+    virtual void apply();
+
+    // Whether sys can be integrated by a typed_engine<Body>
+    static bool accepts(const system& sys);
+
+  private:
+    system* m_sys;
+    std::vector<Body*> m_bodies;
+    std::vector<y_value> m_y;
+    std::vector<const Body*> m_backups;
+    // dt*f() at the start of the step, with dt = 1
+    std::vector<std::vector<k_value> > m_f1;
+    std::vector<std::vector<k_value> > m_k_vecs;
+    std::vector<k_value> m_k;
+    // The step size, and the same as a 1-vector of coefficients for axpy()
+    scalar_time m_step;
+    std::vector<scalar> m_dt;
+    scalar_time m_unit;
+
+    static k_type& get(k_value& k) { return static_cast<k_type&>(*k.base()); }
+
+    // Give k a k_type of its own, the first time it's needed
+    void alloc(k_value& k, unsigned int i);
+  };
+
+  // A Runge-Kutta integrator with a fixed tableau, which uses a
+  // typed_engine<Body> whenever the system allows it, and falls back to the
+  // usual polymorphic path otherwise
+  template <typename Tableau, typename Body>
+  class basic_RK_integrator : public simple_integrator
+  {
+  public:
+    basic_RK_integrator(system& sys);
+    ~basic_RK_integrator();
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+
+  private:
+    Tableau m_tableau;
+  };
+
+  // The same, for tableaux with embeded methods
+  template <typename Tableau, typename Body>
+  class basic_adaptive_RK_integrator : public adaptive_integrator
+  {
+  public:
+    basic_adaptive_RK_integrator(system& sys, const scalar& tol);
+    ~basic_adaptive_RK_integrator();
+
+  protected:
+    virtual scalar_time step(const scalar_time& dt, scalar_time& elapsed);
+    virtual bool continuous() const;
+
+  private:
+    Tableau m_tableau;
+  };
+
+  template <typename Body>
+  typed_engine<Body>::typed_engine(system& sys)
+    : m_sys(&sys), m_y(sys.size()), m_backups(sys.size()), m_f1(sys.size()),
+      m_k_vecs(sys.size()), m_k(sys.size()), m_dt(1), m_unit(1) {
+    for (system::iterator i = sys.begin(); i != sys.end(); ++i) {
+      m_bodies.push_back(static_cast<Body*>(&*i));
+    }
+    apply();
+  }
+
+  template <typename Body>
+  typed_engine<Body>::~typed_engine() { }
+
+  template <typename Body>
+  void typed_engine<Body>::k(const a_vector& a_vecs, const scalar_time& dt) {
+    unsigned int n = a_vecs.size() + 1;
+
+    // k1 = dt*f1
+    m_step = dt;
+    m_dt[0] = convert<scalar>(dt);
+    for (unsigned int i = 0; i < m_bodies.size(); ++i) {
+      m_k_vecs[i].resize(n);
+      for (unsigned int j = 0; j < n; ++j) {
+        alloc(m_k_vecs[i][j], i);
+      }
+      get(m_k_vecs[i][0]).k_type::axpy(m_dt, m_f1[i]);
+    }
+
+    // Find k2..n
+    for (unsigned int i = 1; i < n; ++i) {
+      for (unsigned int j = 0; j < m_bodies.size(); ++j) {
+        get(m_k[j]).k_type::axpy(a_vecs[i-1], m_k_vecs[j]);
+        m_bodies[j]->Body::step(*m_backups[j], get(m_k[j]));
+      }
+
+      for (unsigned int j = 0; j < m_bodies.size(); ++j) {
+        m_bodies[j]->Body::k(dt, get(m_k_vecs[j][i]));
+      }
+    }
+  }
+
+  template <typename Body>
+  void typed_engine<Body>::y(const b_vector& b_vec) {
+    for (unsigned int i = 0; i < m_bodies.size(); ++i) {
+      get(m_k[i]).k_type::axpy(b_vec, m_k_vecs[i]);
+      m_bodies[i]->Body::step(*m_backups[i], get(m_k[i]));
+    }
+    m_sys->collision();
+  }
+
+  template <typename Body>
+  scalar typed_engine<Body>::error(const b_vector& e_vec, error_norm& norm) {
+    norm.clear();
+    for (unsigned int i = 0; i < m_bodies.size(); ++i) {
+      get(m_k[i]).k_type::axpy(e_vec, m_k_vecs[i]);
+      get(m_k[i]).k_type::error(*m_backups[i], m_step, norm);
+    }
+    return norm.value();
+  }
+
+  template <typename Body>
+  void typed_engine<Body>::apply() {
+    for (unsigned int i = 0; i < m_bodies.size(); ++i) {
+      m_bodies[i]->body::y(m_y[i]);
+      m_backups[i] = static_cast<const Body*>(m_y[i].base()->backup());
+
+      if (m_f1[i].empty()) {
+        m_f1[i].push_back(m_unit*m_bodies[i]->f());
+        alloc(m_k[i], i);
+      } else {
+        m_bodies[i]->Body::k(m_unit, get(m_f1[i][0]));
+      }
+    }
+  }
+
+  template <typename Body>
+  bool typed_engine<Body>::accepts(const system& sys) {
+    for (system::const_iterator i = sys.begin(); i != sys.end(); ++i) {
+      if (typeid(*i) != typeid(Body) &&
+          typeid(*i) != typeid(impenetrable_body<Body>)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename Body>
+  void typed_engine<Body>::alloc(k_value& k, unsigned int i) {
+    if (!k.base()) {
+      k = k_value(m_f1[i][0].base()->clone());
+    }
+  }
+
+  template <typename Tableau, typename Body>
+  basic_RK_integrator<Tableau, Body>::basic_RK_integrator(system& sys)
+    : simple_integrator(sys) {
+    if (typed_engine<Body>::accepts(sys)) {
+      engine(new typed_engine<Body>(sys));
+    }
+  }
+
+  template <typename Tableau, typename Body>
+  basic_RK_integrator<Tableau, Body>::~basic_RK_integrator() { }
+
+  template <typename Tableau, typename Body>
+  scalar_time
+  basic_RK_integrator<Tableau, Body>::step(const scalar_time& dt,
+                                           scalar_time& elapsed) {
+    return simple_step(dt, elapsed, m_tableau);
+  }
+
+  template <typename Tableau, typename Body>
+  basic_adaptive_RK_integrator<Tableau, Body>::
+  basic_adaptive_RK_integrator(system& sys, const scalar& tol)
+    : adaptive_integrator(sys, tol, Tableau().order()) {
+    if (typed_engine<Body>::accepts(sys)) {
+      engine(new typed_engine<Body>(sys));
+    }
+  }
+
+  template <typename Tableau, typename Body>
+  basic_adaptive_RK_integrator<Tableau, Body>::
+  ~basic_adaptive_RK_integrator() { }
+
+  template <typename Tableau, typename Body>
+  scalar_time
+  basic_adaptive_RK_integrator<Tableau, Body>::step(const scalar_time& dt,
+                                                    scalar_time& elapsed) {
+    return adaptive_step(dt, elapsed, m_tableau);
+  }
+
+  template <typename Tableau, typename Body>
+  bool basic_adaptive_RK_integrator<Tableau, Body>::continuous() const {
+    return m_tableau.dense();
+  }
+}
+
+#endif // CAROM_TYPED_ENGINE_HPP
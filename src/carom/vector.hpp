@@ -117,6 +117,16 @@ namespace carom
       return *this;
     }
 
+    // Fused *this += a*n, with a single rounding and no temporaries
+    vector_units& addmul(const scalar_units<0, 0, 0>& a,
+                         const vector_units<m, d, t>& n) {
+      update_precision();
+      mpfr_fma(m_x, a.mpfr(), n.m_x, m_x, GMP_RNDN);
+      mpfr_fma(m_y, a.mpfr(), n.m_y, m_y, GMP_RNDN);
+      mpfr_fma(m_z, a.mpfr(), n.m_z, m_z, GMP_RNDN);
+      return *this;
+    }
+
     scalar_units<m, d, t> x() const
     { scalar_units<m, d, t> r; mpfr_set(r.mpfr(), m_x, GMP_RNDN); return r; }
     scalar_units<m, d, t> y() const
@@ -164,6 +174,25 @@ namespace carom
     return r;
   }
 
+  // Copy the components of a vector to or from three consecutive unitless
+  // scalars, for flat state vectors
+
+  template <int m, int d, int t>
+  inline void flatten(const vector_units<m, d, t>& n,
+                      scalar_units<0, 0, 0>* r) {
+    mpfr_set(r[0].mpfr(), n.mpfr_x(), GMP_RNDN);
+    mpfr_set(r[1].mpfr(), n.mpfr_y(), GMP_RNDN);
+    mpfr_set(r[2].mpfr(), n.mpfr_z(), GMP_RNDN);
+  }
+
+  template <int m, int d, int t>
+  inline void unflatten(vector_units<m, d, t>& r,
+                        const scalar_units<0, 0, 0>* n) {
+    mpfr_set(r.mpfr_x(), n[0].mpfr(), GMP_RNDN);
+    mpfr_set(r.mpfr_y(), n[1].mpfr(), GMP_RNDN);
+    mpfr_set(r.mpfr_z(), n[2].mpfr(), GMP_RNDN);
+  }
+
   // Operators
 
   template <int m, int d, int t>
@@ -18,6 +18,7 @@
  *************************************************************************/
 
 #include <carom.hpp>
+#include <vector>
 
 namespace carom
 {
@@ -34,7 +35,9 @@ namespace carom
                              );
 
   electromagnetic_force::electromagnetic_force(const particle& x)
-    : m_x(&x), m_q(dynamic_cast<const charge*>(&x)) { }
+    : m_x(&x), m_q(dynamic_cast<const charge*>(&x)) {
+    scale(slow);
+  }
   electromagnetic_force::~electromagnetic_force() { }
 
   scalar_permitivity_constant electromagnetic_force::e() { return s_e; }
@@ -54,17 +57,75 @@ namespace carom
     const charge* q = dynamic_cast<const charge*>(&x);
 
     if (q != 0) {
-      vector_displacement r = m_x->s() - x.s();
-      vector_electric_field E =
-        m_q->q()*normalized(r)/(4*pi()*e()*norm(r)*norm(r));
-      vector_magnetic_field B =
-        u()*m_q->q()*cross(m_x->v(), normalized(r))/(4*pi()*norm(r)*norm(r));
+      vector_electric_field E = 0;
+      vector_magnetic_field B = 0;
+      field(x, E, B);
       return q->q()*(E + cross(x.v(), B));
     } else {
       return 0;
     }
   }
 
+  void electromagnetic_force::field(const particle& x,
+                                    vector_electric_field& E,
+                                    vector_magnetic_field& B) const {
+    // The fields of the moving charge m_x
+    vector_displacement r = m_x->s() - x.s();
+    E += m_q->q()*normalized(r)/(4*pi()*e()*norm(r)*norm(r));
+    B += u()*m_q->q()*cross(m_x->v(), normalized(r))/(4*pi()*norm(r)*norm(r));
+  }
+
+  bool electromagnetic_force::taylor(const particle& x,
+                                     const taylor_state& state,
+                                     std::vector<series>& w, unsigned int k,
+                                     scalar* F) const {
+    // As in force(), with r = s2 - s1, E = q2*r/(4*pi*e*|r|^3) and
+    // v1 X B = u*q2*p1 X (p2 X r)/(4*pi*m1*m2*|r|^3)
+    const charge* q = dynamic_cast<const charge*>(&x);
+    if (q == 0) {
+      return true;
+    }
+
+    const series* s1 = state.s(x);
+    const series* p1 = state.p(x);
+    const series* s2 = state.s(*m_x);
+    const series* p2 = state.p(*m_x);
+    if (!s2 || !m_q) {
+      return false;
+    }
+    w.resize(17);
+    series* r = &w[0];
+    series* g = &w[5];  // r/|r|^3
+    series* c = &w[8];  // p2 X r
+    series* h = &w[11]; // p2 X r/|r|^3
+    series* b = &w[14]; // p1 X h
+
+    for (unsigned int i = 0; i < 3; ++i) {
+      subtract(r[i], s2[i], s1[i], k);
+    }
+    dot(w[3], r, r, k);
+    if (k == 0 && sgn(w[3][0]) == 0) {
+      return false;
+    }
+    pow(w[4], w[3], -scalar(3)/2, k);
+
+    cross(c, p2, r, k);
+    for (unsigned int i = 0; i < 3; ++i) {
+      multiply(g[i], w[4], r[i], k);
+      multiply(h[i], w[4], c[i], k);
+    }
+    cross(b, p1, h, k);
+
+    scalar cE = convert<scalar>(q->q()*m_q->q()/(4*pi()*e()));
+    scalar cB = convert<scalar>(q->q()*u()*m_q->q()
+                                /(4*pi()*x.m()*m_x->m()));
+    for (unsigned int i = 0; i < 3; ++i) {
+      F[i].addmul(cE, g[i][k]);
+      F[i].addmul(cB, b[i][k]);
+    }
+    return true;
+  }
+
   electric_force::electric_force(const vector_electric_field& E) : m_E(E) { }
   electric_force::~electric_force() { }
 
@@ -78,6 +139,25 @@ namespace carom
     }
   }
 
+  bool electric_force::taylor(const particle& x, const taylor_state& state,
+                              std::vector<series>& w, unsigned int k,
+                              scalar* F) const {
+    const charge* q = dynamic_cast<const charge*>(&x);
+    if (q != 0 && k == 0) {
+      scalar F0[3];
+      flatten(q->q()*m_E, F0);
+      for (unsigned int i = 0; i < 3; ++i) {
+        F[i] += F0[i];
+      }
+    }
+    return true;
+  }
+
+  void electric_force::field(const particle& x, vector_electric_field& E,
+                             vector_magnetic_field& B) const {
+    E += m_E;
+  }
+
   magnetic_force::magnetic_force(const vector_magnetic_field& B) : m_B(B) { }
   magnetic_force::~magnetic_force() { }
 
@@ -91,4 +171,26 @@ namespace carom
     }
   }
 
+  bool magnetic_force::taylor(const particle& x, const taylor_state& state,
+                              std::vector<series>& w, unsigned int k,
+                              scalar* F) const {
+    // F = (q/m)*p X B, linear in p
+    const charge* q = dynamic_cast<const charge*>(&x);
+    if (q != 0) {
+      const series* p = state.p(x);
+      scalar B[3];
+      flatten(m_B, B);
+      scalar c = convert<scalar>(q->q()/x.m());
+      for (unsigned int i = 0; i < 3; ++i) {
+        unsigned int i1 = (i + 1)%3, i2 = (i + 2)%3;
+        F[i].addmul(c, p[i1][k]*B[i2] - p[i2][k]*B[i1]);
+      }
+    }
+    return true;
+  }
+
+  void magnetic_force::field(const particle& x, vector_electric_field& E,
+                             vector_magnetic_field& B) const {
+    B += m_B;
+  }
 }
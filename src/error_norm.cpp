@@ -0,0 +1,73 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+#include <algorithm> // For max()
+
+namespace carom
+{
+  error_norm::error_norm(const scalar& tol) : m_method(max_norm) {
+    this->tol(tol);
+    clear();
+  }
+
+  void error_norm::tol(const scalar& tol) {
+    for (unsigned int i = 0; i < 4; ++i) {
+      m_atol[i] = tol;
+      m_rtol[i] = tol;
+    }
+  }
+
+  void error_norm::tol(quantity q, const scalar& atol, const scalar& rtol) {
+    m_atol[q] = atol;
+    m_rtol[q] = rtol;
+  }
+
+  scalar error_norm::atol(quantity q) const { return m_atol[q]; }
+  scalar error_norm::rtol(quantity q) const { return m_rtol[q]; }
+
+  error_norm::combination error_norm::method() const { return m_method; }
+  void error_norm::method(combination method) { m_method = method; }
+
+  void error_norm::clear() {
+    m_sum = 0;
+    m_count = 0;
+  }
+
+  void error_norm::add(quantity q, const scalar& e, const scalar& y) {
+    m_e = m_rtol[q]*abs(y);
+    m_e += m_atol[q];
+    m_e = abs(e)/m_e;
+
+    if (m_method == max_norm) {
+      m_sum = std::max(m_sum, m_e);
+    } else {
+      m_sum.addmul(m_e, m_e);
+    }
+    ++m_count;
+  }
+
+  scalar error_norm::value() const {
+    if (m_method == max_norm || m_count == 0) {
+      return m_sum;
+    } else {
+      return sqrt(m_sum/m_count);
+    }
+  }
+}
@@ -0,0 +1,81 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+
+namespace carom
+{
+  event::event(direction dir) : m_dir(dir) { }
+  event::~event() { }
+
+  event::direction event::crossing() const { return m_dir; }
+
+  distance_event::distance_event(particle& x, particle& y,
+                                 const scalar_distance& d)
+    : event(falling), m_x(&x), m_y(&y), m_d(d) { }
+
+  distance_event::~distance_event() { }
+
+  scalar distance_event::value(const system& sys) const {
+    return convert<scalar>(norm(m_y->s() - m_x->s()) - m_d);
+  }
+
+  bool distance_event::occur(system& sys) { return true; }
+
+  particle& distance_event::x() { return *m_x; }
+  particle& distance_event::y() { return *m_y; }
+
+  contact_event::contact_event(particle& x, particle& y,
+                               const scalar_distance& d)
+    : distance_event(x, y, d) { }
+
+  contact_event::~contact_event() { }
+
+  bool contact_event::occur(system& sys) {
+    // Find the bodies that take the impulse
+    body* bx = 0;
+    body* by = 0;
+    for (system::iterator b = sys.begin(); b != sys.end(); ++b) {
+      for (body::iterator i = b->begin(); i != b->end(); ++i) {
+        if (&*i == &x()) {
+          bx = &*b;
+        }
+        if (&*i == &y()) {
+          by = &*b;
+        }
+      }
+    }
+    if (!bx || !by) {
+      return false;
+    }
+
+    // Elastic collision response along the line of centers, if they're
+    // still approaching
+    vector n = normalized(y().s() - x().s());
+    scalar_speed u = dot(y().v() - x().v(), n);
+    if (u < 0) {
+      scalar_mass m1 = bx->mass(x());
+      scalar_mass m2 = by->mass(y());
+      vector_momentum dp = 2*m1*m2*u*n/(m1 + m2);
+      bx->collision(x(), dp);
+      by->collision(y(), -dp);
+    }
+    return false;
+  }
+}
@@ -0,0 +1,109 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+#include <algorithm> // For max()
+#include <vector>
+
+namespace carom
+{
+  flat_engine::flat_engine(system& sys) : m_state(sys), m_k(1) {
+    apply();
+  }
+
+  flat_engine::~flat_engine() { }
+
+  void flat_engine::k(const a_vector& a_vecs, const scalar_time& dt) {
+    m_dt = convert<scalar>(dt);
+
+    // One stage more than the number of rows of a-values
+    m_k.resize(a_vecs.size() + 1, state_vector(m_y0.size()));
+
+    for (unsigned int i = 1; i < m_k.size(); ++i) {
+      combine(m_ytmp, a_vecs[i-1]);
+      m_state.scatter(m_ytmp);
+      m_state.derivative(m_ytmp, m_k[i]);
+    }
+  }
+
+  void flat_engine::y(const b_vector& b_vec) {
+    combine(m_ytmp, b_vec);
+    m_state.scatter(m_ytmp);
+    m_state.sys().collision();
+  }
+
+  scalar flat_engine::error(const b_vector& e_vec, error_norm& norm) {
+    // m_ytmp is free until y(); use it for dt*sum(e[i]*k[i])
+    for (unsigned int i = 0; i < m_ytmp.size(); ++i) {
+      m_ytmp[i] = 0;
+    }
+
+    scalar c;
+    for (unsigned int j = 0; j < e_vec.size(); ++j) {
+      if (sgn(e_vec[j]) != 0) {
+        c = m_dt*e_vec[j];
+        const state_vector& k = m_k[j];
+        for (unsigned int i = 0; i < m_ytmp.size(); ++i) {
+          m_ytmp[i].addmul(c, k[i]);
+        }
+      }
+    }
+
+    norm.clear();
+    m_state.error(m_y0, m_ytmp, norm);
+    return norm.value();
+  }
+
+  void flat_engine::apply() {
+    m_state.gather(m_y0);
+    m_ytmp.resize(m_y0.size());
+    for (unsigned int i = 0; i < m_k.size(); ++i) {
+      m_k[i].resize(m_y0.size());
+    }
+    m_state.derivative(m_y0, m_k[0]);
+  }
+
+  const flat_engine::state_vector& flat_engine::state() const { return m_y0; }
+
+  std::size_t flat_engine::offset(unsigned int i) const {
+    return m_state.offset(i);
+  }
+
+  const flat_engine::state_vector&
+  flat_engine::derivative(unsigned int i) const {
+    return m_k[i];
+  }
+
+  void flat_engine::combine(state_vector& r, const b_vector& b_vec) {
+    for (unsigned int i = 0; i < r.size(); ++i) {
+      r[i] = m_y0[i];
+    }
+
+    scalar c;
+    for (unsigned int j = 0; j < b_vec.size(); ++j) {
+      if (sgn(b_vec[j]) != 0) {
+        c = m_dt*b_vec[j];
+        const state_vector& k = m_k[j];
+        for (unsigned int i = 0; i < r.size(); ++i) {
+          r[i].addmul(c, k[i]);
+        }
+      }
+    }
+  }
+}
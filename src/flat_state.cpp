@@ -0,0 +1,249 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+#include <boost/bind/bind.hpp>
+#include <algorithm> // For max(), swap()
+#include <vector>
+
+namespace carom
+{
+  flat_state::flat_state(system& sys)
+    : m_sys(&sys), m_threads(0), m_offsets(1, 0) { }
+
+  system& flat_state::sys() { return *m_sys; }
+
+  void flat_state::gather(state_vector& y) {
+    m_bodies.resize(m_sys->size());
+    m_y.resize(m_sys->size());
+    m_offsets.resize(m_sys->size() + 1);
+
+    // Bodies may have gained or lost particles since the last gather
+    m_offsets[0] = 0;
+    system::iterator b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      m_bodies[i] = &*b;
+      m_offsets[i + 1] = m_offsets[i] + b->dimension();
+    }
+    y.resize(m_offsets.back());
+
+    b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      b->y(m_y[i]);
+      b->flatten(m_y[i], &y[0] + m_offsets[i]);
+    }
+  }
+
+  void flat_state::scatter(const state_vector& y) {
+    system::iterator b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      b->unflatten(m_y[i], &y[0] + m_offsets[i]);
+    }
+  }
+
+  void flat_state::restore() {
+    system::iterator b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      b->apply(m_y[i]);
+    }
+  }
+
+  void flat_state::derivative(const state_vector& y, state_vector& dy) {
+    if (m_threads) {
+      // Each body only writes its own particles and slice of dy
+      m_threads->run(m_bodies.size(),
+                     boost::bind(&flat_state::body_derivative, this, &y, &dy,
+                                 boost::placeholders::_1));
+      return;
+    }
+
+    system::iterator b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      b->derivative(&y[0] + m_offsets[i], &dy[0] + m_offsets[i]);
+    }
+  }
+
+  void flat_state::coordinate_derivative(const state_vector& y,
+                                         state_vector& dy) {
+    system::iterator b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      b->coordinate_derivative(&y[0] + m_offsets[i], &dy[0] + m_offsets[i]);
+    }
+  }
+
+  void flat_state::momentum_derivative(const state_vector& y,
+                                       state_vector& dy) {
+    system::iterator b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      b->momentum_derivative(&y[0] + m_offsets[i], &dy[0] + m_offsets[i]);
+    }
+  }
+
+  void flat_state::momentum_derivative(const state_vector& y,
+                                       state_vector& dy,
+                                       applied_force::timescale scale) {
+    system::iterator b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      b->momentum_derivative(&y[0] + m_offsets[i], &dy[0] + m_offsets[i],
+                             scale);
+    }
+  }
+
+  void flat_state::error(const state_vector& y, const state_vector& e,
+                         error_norm& norm) {
+    system::iterator b = m_sys->begin();
+    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
+      b->error(&y[0] + m_offsets[i], &e[0] + m_offsets[i], norm);
+    }
+  }
+
+  void flat_state::derivative(unsigned int i, const state_vector& y,
+                              state_vector& dy) {
+    m_bodies[i]->derivative(&y[0] + m_offsets[i], &dy[0] + m_offsets[i]);
+  }
+
+  void flat_state::error(unsigned int i, const state_vector& y,
+                         const state_vector& e, error_norm& norm) {
+    m_bodies[i]->error(&y[0] + m_offsets[i], &e[0] + m_offsets[i], norm);
+  }
+
+  std::size_t flat_state::size() const { return m_offsets.back(); }
+
+  std::size_t flat_state::offset(unsigned int i) const {
+    return m_offsets.at(i);
+  }
+
+  thread_pool* flat_state::threads() const { return m_threads; }
+  void flat_state::threads(thread_pool* pool) { m_threads = pool; }
+
+  void flat_state::body_derivative(const state_vector* y, state_vector* dy,
+                                   std::size_t i) {
+    derivative(i, *y, *dy);
+  }
+
+  flat_jacobian::flat_jacobian(flat_state& state)
+    : m_state(&state), m_n(0) { }
+
+  void flat_jacobian::evaluate(state_vector& y, const state_vector& f) {
+    if (m_n != y.size()) {
+      m_n = y.size();
+      m_J.resize(m_n*m_n);
+      m_LU.resize(m_n*m_n);
+      m_pivots.resize(m_n);
+      m_f.resize(m_n);
+    }
+    for (std::size_t i = 0; i < m_J.size(); ++i) {
+      m_J[i] = 0;
+    }
+
+    // Perturb each component by about sqrt(epsilon), relative to its size
+    scalar h = pow(scalar(2), -scalar(precision())/2);
+    scalar d, yj;
+    bool perturbed = false;
+
+    system::iterator b = m_state->sys().begin();
+    for (unsigned int i = 0; i < m_state->sys().size(); ++i, ++b) {
+      std::size_t begin = m_state->offset(i), end = m_state->offset(i + 1);
+      if (b->jacobian(&y[0] + begin, &m_J[0] + begin*m_n + begin, m_n)) {
+        continue;
+      }
+
+      for (std::size_t j = begin; j < end; ++j) {
+        yj = y[j];
+        y[j] += h*std::max(abs(yj), scalar(1));
+        d = y[j] - yj; // Exactly representable
+
+        m_state->scatter(y);
+        m_state->derivative(y, m_f);
+        for (std::size_t k = 0; k < m_n; ++k) {
+          m_J[k*m_n + j] = (m_f[k] - f[k])/d;
+        }
+
+        y[j] = yj;
+      }
+      perturbed = true;
+    }
+
+    if (perturbed) {
+      m_state->scatter(y);
+    }
+  }
+
+  void flat_jacobian::factor(const scalar& c) {
+    for (std::size_t i = 0; i < m_LU.size(); ++i) {
+      m_LU[i] = -c*m_J[i];
+    }
+    for (std::size_t i = 0; i < m_n; ++i) {
+      m_LU[i*m_n + i] += 1;
+    }
+
+    // Doolittle elimination, storing the multipliers below the diagonal
+    scalar l;
+    for (std::size_t k = 0; k < m_n; ++k) {
+      std::size_t p = k;
+      for (std::size_t i = k + 1; i < m_n; ++i) {
+        if (abs(m_LU[i*m_n + k]) > abs(m_LU[p*m_n + k])) {
+          p = i;
+        }
+      }
+      m_pivots[k] = p;
+      if (p != k) {
+        for (std::size_t j = 0; j < m_n; ++j) {
+          std::swap(m_LU[k*m_n + j], m_LU[p*m_n + j]);
+        }
+      }
+
+      if (sgn(m_LU[k*m_n + k]) == 0) {
+        continue; // Singular; leave the column be
+      }
+      for (std::size_t i = k + 1; i < m_n; ++i) {
+        if (sgn(m_LU[i*m_n + k]) != 0) {
+          l = m_LU[i*m_n + k]/m_LU[k*m_n + k];
+          m_LU[i*m_n + k] = l;
+          l = -l;
+          for (std::size_t j = k + 1; j < m_n; ++j) {
+            m_LU[i*m_n + j].addmul(l, m_LU[k*m_n + j]);
+          }
+        }
+      }
+    }
+  }
+
+  void flat_jacobian::solve(state_vector& b) const {
+    for (std::size_t k = 0; k < m_n; ++k) {
+      if (m_pivots[k] != k) {
+        std::swap(b[k], b[m_pivots[k]]);
+      }
+    }
+
+    for (std::size_t i = 0; i < m_n; ++i) {
+      for (std::size_t j = 0; j < i; ++j) {
+        b[i].addmul(-m_LU[i*m_n + j], b[j]);
+      }
+    }
+    for (std::size_t i = m_n; i-- > 0;) {
+      for (std::size_t j = i + 1; j < m_n; ++j) {
+        b[i].addmul(-m_LU[i*m_n + j], b[j]);
+      }
+      if (sgn(m_LU[i*m_n + i]) != 0) {
+        b[i] /= m_LU[i*m_n + i];
+      }
+    }
+  }
+}
@@ -18,22 +18,103 @@
  *************************************************************************/
 
 #include <carom.hpp>
-#include <boost/utility.hpp> // For next()/prior()
+#include <boost/bind/bind.hpp>
 #include <algorithm> // For max()
 #include <vector>
 
 namespace carom
 {
-  integrator::integrator(system& sys)
-    : m_sys(&sys), m_f1(sys.size()), m_y(sys.size()) {
+  integrator_engine::~integrator_engine() { }
+
+  void integrator_engine::threads(thread_pool* pool) { }
+
+  body_engine::body_engine(system& sys)
+    : m_sys(&sys), m_threads(0), m_weights(0), m_stage(0), m_f1(sys.size()),
+      m_y(sys.size()), m_k_vecs(sys.size()), m_k(sys.size()) {
+    apply();
+  }
+
+  body_engine::~body_engine() { }
+
+  void body_engine::k(const a_vector& a_vecs, const scalar_time& dt) {
+    m_dt = dt;
+
+    unsigned int n = 1;
+    if (!a_vecs.empty()) {
+      // The number of k-values is equal to the number of entries in the last
+      // row of the a-value matrix plus one
+      n = a_vecs.back().size() + 1;
+    }
+
+    // Find k1 using m_f1
+    for (unsigned int i = 0; i < m_k_vecs.size(); ++i) {
+      m_k_vecs[i].resize(n);
+      m_k_vecs[i][0] = dt*m_f1[i];
+    }
+
+    // Find k2..n
+    for (m_stage = 1; m_stage < n; ++m_stage) {
+      m_weights = &a_vecs[m_stage - 1];
+      each(&body_engine::step);
+      each(&body_engine::evaluate);
+    }
+  }
+
+  void body_engine::y(const b_vector& b_vec) {
+    m_weights = &b_vec;
+    each(&body_engine::step);
     m_sys->collision();
+  }
+
+  scalar body_engine::error(const b_vector& e_vec, error_norm& norm) {
+    norm.clear();
+    for (unsigned int i = 0; i < m_k_vecs.size(); ++i) {
+      m_k[i].axpy(e_vec, m_k_vecs[i]);
+      m_k[i].base()->error(*m_y[i].base()->backup(), m_dt, norm);
+    }
+    return norm.value();
+  }
+
+  void body_engine::apply() {
+    m_bodies.resize(m_sys->size());
     system::iterator j = m_sys->begin();
     for (unsigned int i = 0; i < m_sys->size(); ++i, ++j) {
-      m_f1[i] = j->f();
-      m_y[i] = j->y();
+      m_bodies[i] = &*j;
+    }
+    each(&body_engine::start);
+  }
+
+  void body_engine::threads(thread_pool* pool) { m_threads = pool; }
+
+  void body_engine::each(void (body_engine::*f)(std::size_t)) {
+    if (m_threads) {
+      m_threads->run(m_bodies.size(),
+                     boost::bind(f, this, boost::placeholders::_1));
+    } else {
+      for (std::size_t j = 0; j < m_bodies.size(); ++j) {
+        (this->*f)(j);
+      }
     }
   }
 
+  void body_engine::step(std::size_t j) {
+    m_k[j].axpy(*m_weights, m_k_vecs[j]);
+    m_bodies[j]->step(m_y[j], m_k[j]);
+  }
+
+  void body_engine::evaluate(std::size_t j) {
+    m_k_vecs[j][m_stage] = m_dt*m_bodies[j]->f();
+  }
+
+  void body_engine::start(std::size_t j) {
+    m_f1[j] = m_bodies[j]->f();
+    m_bodies[j]->y(m_y[j]);
+  }
+
+  integrator::integrator(system& sys) : m_sys(&sys) {
+    m_sys->collision();
+  }
+
   integrator::~integrator() { }
 
   scalar_time integrator::integrate(const scalar_time& t,
@@ -50,146 +131,415 @@ namespace carom
     return delta;
   }
 
-  integrator::k_vector integrator::k(const integrator::a_vector& a_vecs,
-                                     const scalar_time& dt) {
-    k_vector k_vecs(m_sys->size());
+  integrator_engine* integrator::engine() {
+    if (!m_engine) {
+      m_engine.reset(new body_engine(*m_sys));
+      m_engine->threads(m_threads.get());
+    }
+    return m_engine.get();
+  }
+
+  const integrator_engine* integrator::engine() const {
+    return m_engine.get();
+  }
 
-    unsigned int n = 1;
-    if (!a_vecs.empty()) {
-      // The number of k-values is equal to the number of entries in the last
-      // row of the a-value matrix plus one
-      n = a_vecs.back().size() + 1;
+  void integrator::engine(integrator_engine* engine) {
+    m_engine.reset(engine);
+    m_engine->threads(m_threads.get());
+  }
+
+  unsigned int integrator::threads() const {
+    return m_threads ? m_threads->size() : 1;
+  }
+
+  void integrator::threads(unsigned int n) {
+    // Take the old pool away from the engine before it's destroyed
+    if (m_engine) {
+      m_engine->threads(0);
     }
+    if (n > 1) {
+      m_threads.reset(new thread_pool(n));
+    } else {
+      m_threads.reset();
+    }
+    if (m_engine) {
+      m_engine->threads(m_threads.get());
+    }
+  }
 
-    // Find k1 using m_f1
-    for (unsigned int i = 0; i < k_vecs.size(); ++i) {
-      k_vecs[i].resize(n);
-      k_vecs[i][0] = dt*m_f1[i];
+  system& integrator::sys() { return *m_sys; }
+  thread_pool* integrator::workers() { return m_threads.get(); }
+
+  void integrator::k(const a_vector& a_vecs, const scalar_time& dt) {
+    engine()->k(a_vecs, dt);
+  }
+
+  void integrator::y(const b_vector& b_vec) { engine()->y(b_vec); }
+
+  scalar integrator::error(const b_vector& e_vec, error_norm& norm) {
+    return engine()->error(e_vec, norm);
+  }
+
+  void integrator::apply() {
+    // An engine made later starts from the current state anyway
+    if (m_engine) {
+      m_engine->apply();
     }
+  }
 
-    // Find k2..n
-    for (unsigned int i = 1; i < n; ++i) {
-      system::iterator b = m_sys->begin();
-      for (unsigned int j = 0; j < m_sys->size(); ++j, ++b) {
-        k_value k = a_vecs[i-1][0]*k_vecs[j][0];
-        for (unsigned int l = 1; l < i; ++l) {
-          k += a_vecs[i-1][l]*k_vecs[j][l];
+  simple_integrator::simple_integrator(system& sys) : integrator(sys) { }
+  simple_integrator::~simple_integrator() { }
+
+  scalar_time simple_integrator::simple_step(const scalar_time& dt,
+                                             scalar_time& elapsed,
+                                             const tableau& t) {
+    k(t.a(), dt);
+    y(t.b());
+    apply();
+    elapsed += dt;
+    return dt;
+  }
+
+  adaptive_integrator::adaptive_integrator(system& sys, const scalar& tol,
+                                           unsigned int order)
+    : integrator(sys), m_norm(tol), m_order(order),
+      m_controller(new PI_controller()), m_dense(false), m_pending(0),
+      m_samples(4), m_stopped(0) { }
+  adaptive_integrator::~adaptive_integrator() { }
+
+  error_norm&       adaptive_integrator::norm()       { return m_norm; }
+  const error_norm& adaptive_integrator::norm() const { return m_norm; }
+
+  scalar_time adaptive_integrator::integrate(const scalar_time& t,
+                                             const scalar_time& dt) {
+    m_stopped = 0;
+    if (!dense() && !watching()) {
+      return integrator::integrate(t, dt);
+    }
+
+    // elapsed is the time at the end of the pending step, if there is one
+    scalar_time elapsed = 0, delta = dt;
+    if (watching()) {
+      values(m_g0);
+    }
+    if (m_pending) {
+      elapsed = m_ahead;
+      delta = m_next;
+      if (watching()) {
+        scalar theta0 = convert<scalar>(1 - m_ahead/m_h);
+        scalar theta1 = elapsed > t ? convert<scalar>(1 - (elapsed - t)/m_h)
+                                    : scalar(1);
+        if (locate(theta0, theta1, elapsed)) {
+          return delta;
         }
-        b->step(m_y[j], k);
       }
+    }
 
-      b = m_sys->begin();
-      for (unsigned int j = 0; j < k_vecs.size(); ++j, ++b) {
-        k_vecs[j][i] = dt*b->f();
+    while (elapsed < t) {
+      finish();
+      delta = step(delta, elapsed);
+      if (watching()) {
+        scalar theta1 = elapsed > t ? convert<scalar>(1 - (elapsed - t)/m_h)
+                                    : scalar(1);
+        if (locate(scalar(0), theta1, elapsed)) {
+          return delta;
+        }
       }
     }
 
-    return k_vecs;
-  }
+    // Interpolate within the last step, unless it ends right at t
+    m_ahead = elapsed - t;
+    if (sgn(m_ahead) == 0) {
+      finish();
+    } else {
+      m_pending->dense(convert<scalar>(1 - m_ahead/m_h), m_b);
+      y(m_b);
+      if (!dense()) {
+        apply();
+        m_pending = 0;
+      }
+    }
 
-  integrator::y_vector integrator::y(const integrator::b_vector& b_vec,
-                                     const integrator::k_vector& k_vecs) {
-    y_vector y_vec(k_vecs.size());
+    return delta;
+  }
 
-    system::iterator b = m_sys->begin();
-    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
-      k_value k = b_vec[0]*k_vecs[i][0];
-      for (unsigned int j = 1; j < b_vec.size(); ++j) {
-        k += b_vec[j]*k_vecs[i][j];
-      }
-      b->step(m_y[i], k);
+  scalar_time adaptive_integrator::integrate(const scalar_time& t) {
+    if (dense() && m_pending) {
+      return integrate(t, m_next);
     }
-    m_sys->collision();
-    b = m_sys->begin();
-    for (unsigned int i = 0; i < m_sys->size(); ++i, ++b) {
-      y_vec[i] = b->y();
+    return integrate(t, initial_step());
+  }
+
+  bool adaptive_integrator::dense() const { return m_dense && continuous(); }
+
+  void adaptive_integrator::dense(bool dense) {
+    if (!dense && m_pending) {
+      // Start again from the interpolated state
+      apply();
+      m_pending = 0;
     }
+    m_dense = dense;
+  }
 
-    return y_vec;
+  adaptive_integrator::event_iterator adaptive_integrator::watch(event* e) {
+    return m_events.insert(m_events.end(), e);
   }
 
-  void integrator::apply(const y_vector& y_vec) {
-    system::iterator j = m_sys->begin();
-    for (unsigned int i = 0; i < m_sys->size(); ++i, ++j) {
-      j->apply(y_vec[i]);
+  void adaptive_integrator::unwatch(event_iterator i) { m_events.erase(i); }
+
+  unsigned int adaptive_integrator::samples() const { return m_samples; }
+
+  void adaptive_integrator::samples(unsigned int n) {
+    m_samples = std::max(n, 1U);
+  }
+
+  event* adaptive_integrator::stopped() const { return m_stopped; }
+  scalar_time adaptive_integrator::stopped_at() const { return m_at; }
+
+  scalar_time adaptive_integrator::initial_step() {
+    typedef flat_state::state_vector state_vector;
+
+    flat_state state(sys());
+    state_vector y0, y1, f0, f1;
+    state.gather(y0);
+    y1.resize(y0.size());
+    f0.resize(y0.size());
+    f1.resize(y0.size());
+    state.derivative(y0, f0);
+
+    // Sizes of y0 and f(y0), relative to the tolerances
+    m_norm.clear();
+    state.error(y0, y0, m_norm);
+    scalar d0 = m_norm.value();
+    m_norm.clear();
+    state.error(y0, f0, m_norm);
+    scalar d1 = m_norm.value();
+
+    // A first guess, from a tiny explicit Euler step
+    scalar h0;
+    if (d0 < scalar("1e-5") || d1 < scalar("1e-5")) {
+      h0 = scalar("1e-6");
+    } else {
+      h0 = d0/d1/100;
     }
-    j = m_sys->begin();
-    for (unsigned int i = 0; i < m_sys->size(); ++i, ++j) {
-      m_f1[i] = j->f();
-      m_y[i] = j->y();
+
+    // An estimate of the second derivative, from one more evaluation
+    for (std::size_t i = 0; i < y1.size(); ++i) {
+      y1[i] = y0[i];
+      y1[i].addmul(h0, f0[i]);
+    }
+    state.scatter(y1);
+    state.derivative(y1, f1);
+    state.restore();
+
+    for (std::size_t i = 0; i < f1.size(); ++i) {
+      f1[i] -= f0[i];
+    }
+    m_norm.clear();
+    state.error(y0, f1, m_norm);
+    scalar d2 = m_norm.value()/h0;
+
+    // The step whose error would be about 1/100 of the tolerance
+    scalar d = std::max(d1, d2), h1;
+    if (d <= scalar("1e-15")) {
+      h1 = std::max(scalar("1e-6"), h0/1000);
+    } else {
+      h1 = pow(100*d, -scalar(1)/(m_order + 1));
     }
+
+    return convert<scalar_time>(std::min(100*h0, h1));
   }
 
-  simple_integrator::simple_integrator(system& sys) : integrator(sys) { }
-  simple_integrator::~simple_integrator() { }
+  step_controller* adaptive_integrator::controller() {
+    return m_controller.get();
+  }
 
-  scalar_time
-  simple_integrator::simple_step(const scalar_time& dt, scalar_time& elapsed,
-                                 const integrator::a_vector& a_vecs,
-                                 const integrator::b_vector& b_vec) {
-    apply(y(b_vec, k(a_vecs, dt)));
-    elapsed += dt;
-    return dt;
+  const step_controller* adaptive_integrator::controller() const {
+    return m_controller.get();
   }
 
-  adaptive_integrator::adaptive_integrator(system& sys, const scalar& tol,
-                                           unsigned int order)
-    : integrator(sys), m_tol(tol), m_order(order), m_err(0), m_steps(0) { }
-  adaptive_integrator::~adaptive_integrator() { }
+  void adaptive_integrator::controller(step_controller* controller) {
+    m_controller.reset(controller);
+  }
 
-  scalar_time
-  adaptive_integrator::adaptive_step(const scalar_time& dt,
-                                     scalar_time& elapsed,
-                                     const integrator::a_vector& a_vecs,
-                                     const integrator::b_vector& b_vec,
-                                     const integrator::b_vector& bstar_vec) {
+  scalar_time adaptive_integrator::adaptive_step(const scalar_time& dt,
+                                                 scalar_time& elapsed,
+                                                 const tableau& t) {
     scalar_time delta, deltaprime = dt;
     scalar err;
 
-    bool rejected = true;
+    // The weights of the error estimate, b[i] - bstar[i]
+    b_vector e_vec(t.stages());
+    for (unsigned int i = 0; i < e_vec.size(); ++i) {
+      e_vec[i] = t.b()[i] - t.bstar()[i];
+    }
 
-    y_vector y_vec;
+    // The tableau may not be the integrator's usual method, as when
+    // stiffness_switching_integrator isn't using ROS2
+    unsigned int order = t.order() != 0 ? t.order() : m_order;
+    bool rejected = true;
 
     while (rejected) {
-      k_vector k_vecs = k(a_vecs, deltaprime);
-      y_vec = y(b_vec, k_vecs);
-      y_vector ystar_vec = y(bstar_vec, k_vecs);
+      k(t.a(), deltaprime);
 
-      // Find the error: the maximum error of any body, where the error of a
-      // body is the difference between the y_value's of the real and embeded
-      // steps
-      err = 0;
-      for (unsigned int i = 0; i < y_vec.size(); ++i) {
-        err = std::max(err, y_vec[i] - ystar_vec[i]);
-      }
+      // Find the error: the norm of the difference between the real and
+      // embeded steps. That difference is simply sum((b[i] - bstar[i])*k[i]),
+      // so neither step has to be taken to find it.
+      err = error(e_vec, m_norm);
 
       // Store the stepsize used for the integration
       delta = deltaprime;
 
-      if (m_steps >= 4 && m_err > 0) {
-        // Find t', the t value that we estimate would have given an error of
-        // err/(1 + tol). If the step is rejected, this is our new stepsize;
-        // otherwise, this is our recommended stepsize for the next iteration.
-        deltaprime *= pow((m_err/m_steps)/(err*(1 + m_tol)),
-                          scalar(1)/(m_order + 1));
+      rejected = !accept(err, order, deltaprime);
+    }
 
-        if (err > (1 + m_tol)*m_err/m_steps) {
-          rejected = true;
-        } else {
-          rejected = false;
-        }
+    accepted(t);
+    elapsed += delta;
+
+    if (dense() || watching()) {
+      // integrate() decides where to put the bodies
+      m_pending = &t;
+      m_h = delta;
+      m_next = deltaprime;
+      return deltaprime;
+    }
+
+    // Only the accepted step is actually taken, and collisions resolved
+    y(t.b());
+    apply();
+
+    return deltaprime;
+  }
+
+  bool adaptive_integrator::accept(const scalar& err, scalar_time& deltaprime) {
+    return m_controller->control(err, m_order, deltaprime);
+  }
+
+  bool adaptive_integrator::accept(const scalar& err, unsigned int order,
+                                   scalar_time& deltaprime) {
+    return m_controller->control(err, order, deltaprime);
+  }
+
+  void adaptive_integrator::accepted(const tableau& t) { }
+
+  bool adaptive_integrator::continuous() const { return false; }
+
+  void adaptive_integrator::finish() {
+    if (m_pending) {
+      y(m_pending->b());
+      apply();
+      m_pending = 0;
+    }
+  }
+
+  bool adaptive_integrator::watching() const {
+    return !m_events.empty() && continuous();
+  }
+
+  void adaptive_integrator::values(std::vector<scalar>& g) {
+    g.resize(m_events.size(), scalar(0));
+    unsigned int i = 0;
+    for (event_iterator e = m_events.begin(); e != m_events.end(); ++e, ++i) {
+      g[i] = e->value(sys());
+    }
+  }
+
+  scalar adaptive_integrator::value(const event& e, const scalar& theta) {
+    m_pending->dense(theta, m_b);
+    y(m_b);
+    return e.value(sys());
+  }
+
+  bool adaptive_integrator::locate(const scalar& theta0, const scalar& theta1,
+                                   scalar_time& elapsed) {
+    scalar a = theta0, b, theta;
+    event* first = 0;
+    for (unsigned int k = 1; !first && k <= m_samples; ++k) {
+      if (k == m_samples && theta1 == 1) {
+        b = 1;
+        y(m_pending->b());
       } else {
-        rejected = false;
+        b = theta0 + (theta1 - theta0)*k/m_samples;
+        m_pending->dense(b, m_b);
+        y(m_b);
       }
+      values(m_g1);
+
+      first = search(a, b, theta);
+      m_g0.swap(m_g1);
+      a = b;
+    }
+    if (!first) {
+      return false;
     }
 
-    m_err += err;
-    ++m_steps;
+    // The event becomes the start of the next step
+    m_pending->dense(theta, m_b);
+    y(m_b);
+    elapsed -= (1 - theta)*m_h;
+    m_pending = 0;
+    bool stop = first->occur(sys());
+    apply();
 
-    elapsed += delta;
-    apply(y_vec);
+    if (stop) {
+      m_stopped = first;
+      m_at = elapsed;
+      return true;
+    }
+    values(m_g0);
+    return false;
+  }
 
-    return deltaprime;
+  event* adaptive_integrator::search(const scalar& theta0,
+                                     const scalar& theta1, scalar& theta) {
+    // The Illinois variant of regula falsi, keeping lo on the side of
+    // theta0, so the bodies end up past the crossing
+    scalar eps = pow(scalar(2), 8 - scalar(precision()));
+    scalar lo, hi, glo, ghi, c, gc;
+    event* first = 0;
+    unsigned int i = 0;
+    for (event_iterator e = m_events.begin(); e != m_events.end(); ++e, ++i) {
+      int s0 = sgn(m_g0[i]);
+      if (s0 == 0 || sgn(m_g1[i]) == s0
+          || (e->crossing() == event::falling && s0 < 0)
+          || (e->crossing() == event::rising && s0 > 0)) {
+        continue;
+      }
+
+      lo = theta0;
+      glo = m_g0[i];
+      hi = theta1;
+      ghi = m_g1[i];
+      int side = 0;
+      for (unsigned int j = 0; j < 100 && hi - lo > eps; ++j) {
+        c = lo - glo*(hi - lo)/(ghi - glo);
+        if (!(c > lo && c < hi)) {
+          c = (lo + hi)/2;
+        }
+        gc = value(*e, c);
+        if (sgn(gc) == s0) {
+          lo = c;
+          glo = gc;
+          if (side < 0) {
+            ghi /= 2;
+          }
+          side = -1;
+        } else {
+          hi = c;
+          ghi = gc;
+          if (side > 0) {
+            glo /= 2;
+          }
+          side = 1;
+        }
+      }
+
+      if (!first || hi < theta) {
+        theta = hi;
+        first = &*e;
+      }
+    }
+    return first;
   }
 
   Euler_integrator::Euler_integrator(system& sys) : simple_integrator(sys) { }
@@ -197,20 +547,7 @@ namespace carom
 
   scalar_time Euler_integrator::step(const scalar_time& dt,
                                      scalar_time& elapsed) {
-    // Euler method. Simplest Runge-Kutta method. First order. Its tableau is:
-    //
-    //   0|
-    //   -+-
-    //    |1
-    //
-    // y[n + 1] = y[n] + dt*f(y[n])
-
-    scalar b[1] = { 1 };
-
-    a_vector a_vecs;
-    b_vector b_vec(b, b + 1);
-
-    return simple_step(dt, elapsed, a_vecs, b_vec);
+    return simple_step(dt, elapsed, m_tableau);
   }
 
   midpoint_integrator::midpoint_integrator(system& sys)
@@ -219,26 +556,7 @@ namespace carom
 
   scalar_time midpoint_integrator::step(const scalar_time& dt,
                                         scalar_time& elapsed) {
-    // Midpoint method. Second order Runge-Kutta method. Requires only two
-    // function evaluations per step. Its tableau is:
-    //
-    //   0  |
-    //   1/2|1/2
-    //   ---+-----
-    //      |0   1
-    //
-    //    k1    = dt*f(y[n])
-    //    k2    = dt*f(y[n] + (dt/2)*k1)
-    // y[n + 1] = y[n] + k2
-
-    scalar a2[1] = { scalar(1)/2 };
-    scalar b[2] = { 0, 1 };
-
-    std::vector<scalar> a_vec_arr[1] = { std::vector<scalar>(a2, a2 + 1) };
-    a_vector a_vecs(a_vec_arr, a_vec_arr + 1);
-    b_vector b_vec(b, b + 2);
-
-    return simple_step(dt, elapsed, a_vecs, b_vec);
+    return simple_step(dt, elapsed, m_tableau);
   }
 
   RK4_integrator::RK4_integrator(system& sys) : simple_integrator(sys) { }
@@ -246,34 +564,7 @@ namespace carom
 
   scalar_time RK4_integrator::step(const scalar_time& dt,
                                    scalar_time& elapsed) {
-    // Classical, fourth order Runge-Kutta method. Requires four function
-    // evaluations per step. Its tableau is:
-    //
-    //   0  |
-    //   1/2|1/2
-    //   1/2|0   1/2
-    //   1  |0   0   1
-    //   ---+---------------
-    //      |1/6 1/3 1/3 1/6
-    //
-    //    k1    = dt*f(y[n])
-    //    k2    = dt*f(y[n] + (dt/2)*k1)
-    //    k3    = dt*f(y[n] + (dt/2)*k2)
-    //    k4    = dt*f(y[n] + dt*k3)
-    // y[n + 1] = y[n] + (k1 + 2*k2 + 2*k3 + k4)/6
-
-    scalar a2[1] = { scalar(1)/2 };
-    scalar a3[2] = { 0          , scalar(1)/2 };
-    scalar a4[3] = { 0          , 0          , 1 };
-    scalar b[4] = { scalar(1)/6, scalar(1)/3, scalar(1)/3, scalar(1)/6 };
-
-    std::vector<scalar> a_vec_arr[3] = { std::vector<scalar>(a2, a2 + 1),
-                                         std::vector<scalar>(a3, a3 + 2),
-                                         std::vector<scalar>(a4, a4 + 3) };
-    a_vector a_vecs(a_vec_arr, a_vec_arr + 3);
-    b_vector b_vec(b, b + 4);
-
-    return simple_step(dt, elapsed, a_vecs, b_vec);
+    return simple_step(dt, elapsed, m_tableau);
   }
 
   RKF45_integrator::RKF45_integrator(system& sys, const scalar& tol)
@@ -282,74 +573,2195 @@ namespace carom
 
   scalar_time RKF45_integrator::step(const scalar_time& dt,
                                      scalar_time& elapsed) {
-    // Fifth-order Runge-Kutta-Fehlberg adaptive method. Requires 6 function
-    // evaluations per step. An embeded fourth-order method gives an estimate
-    // of the local truncation error, which is used to either reject the step
-    // or find a recommendation for the next stepsize.
-
-    scalar a2[1] = { scalar(1)/4 };
-    scalar a3[2] = { scalar(3)/32, scalar(9)/32 };
-    scalar a4[3] = { scalar(1932)/2197, -scalar(7200)/2197, scalar(7296)/2197 };
-    scalar a5[4] = { scalar(439)/216, -8, scalar(3680)/513,
-                     -scalar(845)/4104 };
-    scalar a6[5] = { -scalar(8)/27, 2, -scalar(3544)/2565, scalar(1859)/4104,
-                     -scalar(11)/40 };
-
-    scalar b[6] = { scalar(16)/135, 0, scalar(6656)/12825, scalar(28561)/56430,
-                    -scalar(9)/50, scalar(2)/55 };
-
-    scalar bstar[6] = { scalar(25)/216, 0, scalar(1408)/2565, scalar(2197)/4104,
-                        -scalar(1)/5, 0 };
-
-    std::vector<scalar> a_vec_arr[5] = { std::vector<scalar>(a2, a2 + 1),
-                                         std::vector<scalar>(a3, a3 + 2),
-                                         std::vector<scalar>(a4, a4 + 3),
-                                         std::vector<scalar>(a5, a5 + 4),
-                                         std::vector<scalar>(a6, a6 + 5) };
-    a_vector a_vecs(a_vec_arr, a_vec_arr + 5);
-    b_vector b_vec(b, b + 6);
-    b_vector bstar_vec(bstar, bstar + 6);
-
-    return adaptive_step(dt, elapsed, a_vecs, b_vec, bstar_vec);
+    return adaptive_step(dt, elapsed, m_tableau);
   }
 
+  bool RKF45_integrator::continuous() const { return true; }
+
   DP45_integrator::DP45_integrator(system& sys, const scalar& tol)
     : adaptive_integrator(sys, tol, 4) { }
   DP45_integrator::~DP45_integrator() { }
 
   scalar_time DP45_integrator::step(const scalar_time& dt,
                                      scalar_time& elapsed) {
-    // Fifth-order Dormand-Prince adaptive method. Requires 7 function
-    // evaluations, rather than 6, because the FSAL optimization hasn't been
-    // applied in this case.
-
-    scalar a2[1] = { scalar(1)/5 };
-    scalar a3[2] = { scalar(3)/40, scalar(9)/40 };
-    scalar a4[3] = { scalar(44)/45, -scalar(56)/15, scalar(32)/9 };
-    scalar a5[4] = { scalar(19372)/6561, -scalar(25360)/2187,
-                     scalar(64448)/6561, -scalar(212)/729 };
-    scalar a6[5] = { scalar(9017)/3168, -scalar(355)/33, scalar(46732)/5247,
-                     scalar(49)/176, -scalar(5103)/18656 };
-    scalar a7[6] = { scalar(35)/384, 0, scalar(500)/1113, scalar(125)/192,
-                     -scalar(2187)/6784, scalar(11)/84 };
-
-    scalar b[7] = { scalar(35)/384, 0, scalar(500)/1113, scalar(125)/192,
-                    -scalar(2187)/6784, scalar(11)/84, 0 };
-
-    scalar bstar[7] = { scalar(5179)/57600, 0, scalar(7571)/16695,
-                        scalar(393)/640, -scalar(92097)/339200,
-                        scalar(187)/2100, scalar(1)/40 };
-
-    std::vector<scalar> a_vec_arr[6] = { std::vector<scalar>(a2, a2 + 1),
-                                         std::vector<scalar>(a3, a3 + 2),
-                                         std::vector<scalar>(a4, a4 + 3),
-                                         std::vector<scalar>(a5, a5 + 4),
-                                         std::vector<scalar>(a6, a6 + 5),
-                                         std::vector<scalar>(a7, a7 + 6) };
-    a_vector a_vecs(a_vec_arr, a_vec_arr + 6);
-    b_vector b_vec(b, b + 7);
-    b_vector bstar_vec(bstar, bstar + 7);
-
-    return adaptive_step(dt, elapsed, a_vecs, b_vec, bstar_vec);
+    return adaptive_step(dt, elapsed, m_tableau);
+  }
+
+  bool DP45_integrator::continuous() const { return true; }
+
+  Bulirsch_Stoer_integrator::Bulirsch_Stoer_integrator(system& sys,
+                                                       const scalar& tol)
+    : adaptive_integrator(sys, tol, 4), m_state(sys), m_kmax(12) {
+    m_state.gather(m_y0);
+    m_f.resize(m_y0.size());
+    m_state.derivative(m_y0, m_f);
+
+    // ODEX's first guess: about 0.6 columns per decimal digit of tolerance
+    unsigned int digits = 0;
+    for (scalar t = tol; t < 1 && digits < 1000; t *= 10) {
+      ++digits;
+    }
+    m_k = std::min(std::max(3*digits/5 + 1, 2U), m_kmax - 1);
+  }
+
+  Bulirsch_Stoer_integrator::~Bulirsch_Stoer_integrator() { }
+
+  unsigned int Bulirsch_Stoer_integrator::max_columns() const {
+    return m_kmax;
+  }
+
+  void Bulirsch_Stoer_integrator::max_columns(unsigned int columns) {
+    m_kmax = std::max(columns, 3U);
+    m_k = std::min(m_k, m_kmax - 1);
+  }
+
+  scalar_time Bulirsch_Stoer_integrator::step(const scalar_time& dt,
+                                              scalar_time& elapsed) {
+    scalar_time delta, deltaprime = dt;
+    scalar H, r, err;
+    unsigned int j = 0;
+
+    // The step size factors suggested by each column, and the work per unit
+    // time at each column, in evaluations
+    std::vector<scalar> factor(m_kmax + 1, scalar(1));
+    std::vector<scalar> work(m_kmax + 1, scalar(0));
+
+    m_T.resize(m_kmax);
+    m_e.resize(m_y0.size());
+    m_state.threads(workers());
+
+    bool rejected = true;
+
+    while (rejected) {
+      delta = deltaprime;
+      H = convert<scalar>(delta);
+
+      unsigned int last = std::min(m_k + 1, m_kmax);
+      for (j = 1; j <= last; ++j) {
+        // Row j: T[j][1] from 2*j substeps, then T[j][l + 1] =
+        // T[j][l] + (T[j][l] - T[j - 1][l])/((n[j]/n[j - l])^2 - 1).
+        // m_T holds row j - 1 and is overwritten with row j as we go.
+        midpoint(2*j, H/(2*j), m_z1);
+        for (unsigned int l = 1; l < j; ++l) {
+          r = scalar(j*j)/((j - l)*(j - l)) - 1;
+          for (std::size_t i = 0; i < m_z1.size(); ++i) {
+            m_e[i] = m_z1[i];
+            m_e[i] -= m_T[l - 1][i];
+            m_e[i] /= r;
+          }
+          m_T[l - 1].swap(m_z1);
+          // m_z1 is now T[j - 1][l]; make it T[j][l + 1]
+          for (std::size_t i = 0; i < m_z1.size(); ++i) {
+            m_z1[i] = m_T[l - 1][i];
+            m_z1[i] += m_e[i];
+          }
+        }
+        m_T[j - 1] = m_z1;
+
+        if (j >= 2) {
+          // The last correction, T[j][j] - T[j][j - 1], estimates the error
+          // of T[j][j - 1], which is of order 2*j - 2
+          norm().clear();
+          m_state.error(m_y0, m_e, norm());
+          err = norm().value();
+
+          const step_controller* c = controller();
+          if (sgn(err) == 0) {
+            factor[j] = c->max_factor();
+          } else {
+            factor[j] = c->safety()*pow(err, -scalar(1)/(2*j - 1));
+            factor[j] = std::min(std::max(factor[j], c->min_factor()),
+                                 c->max_factor());
+          }
+          // 1 + 2 + 4 + ... + 2*j evaluations
+          work[j] = (1 + j*(j + 1))/factor[j];
+
+          if (j + 1 >= m_k && err <= 1) {
+            break;
+          }
+        }
+      }
+      j = std::min(j, last);
+
+      rejected = !accept(err, 2*j - 2, deltaprime);
+
+      // Move towards the number of columns with the least work per unit
+      // time, ODEX-style; more only after a success at the expected column
+      unsigned int k = j;
+      if (j >= 3 && work[j - 1] < scalar("0.8")*work[j]) {
+        k = j - 1;
+        deltaprime *= factor[j - 1]/factor[j];
+      } else if (!rejected && j >= m_k && j < m_kmax - 1
+                 && work[j] < scalar("0.9")*work[j - 1]) {
+        k = j + 1;
+        deltaprime *= scalar(1 + (j + 1)*(j + 2))/(1 + j*(j + 1));
+      }
+      m_k = k;
+    }
+
+    m_state.scatter(m_T[j - 1]);
+    sys().collision();
+
+    m_state.gather(m_y0);
+    m_f.resize(m_y0.size());
+    m_state.derivative(m_y0, m_f);
+
+    elapsed += delta;
+    return deltaprime;
+  }
+
+  void Bulirsch_Stoer_integrator::midpoint(unsigned int n, const scalar& h,
+                                           state_vector& z) {
+    // z[0] = y0, z[1] = z[0] + h*f(z[0]), z[m + 1] = z[m - 1] + 2*h*f(z[m]),
+    // and Gragg's smoothing, z = (z[n] + z[n - 1] + h*f(z[n]))/2
+    scalar h2 = 2*h;
+    m_z0 = m_y0;
+    z.resize(m_y0.size());
+    m_dz.resize(m_y0.size());
+    for (std::size_t i = 0; i < z.size(); ++i) {
+      z[i] = m_y0[i];
+      z[i].addmul(h, m_f[i]);
+    }
+
+    for (unsigned int m = 1; m <= n; ++m) {
+      m_state.scatter(z);
+      m_state.derivative(z, m_dz);
+      if (m == n) {
+        break;
+      }
+      for (std::size_t i = 0; i < z.size(); ++i) {
+        m_z0[i].addmul(h2, m_dz[i]);
+      }
+      m_z0.swap(z);
+    }
+
+    for (std::size_t i = 0; i < z.size(); ++i) {
+      z[i] += m_z0[i];
+      z[i].addmul(h, m_dz[i]);
+      z[i] /= 2;
+    }
+  }
+
+  Taylor_integrator::Taylor_integrator(system& sys, const scalar& tol)
+    : adaptive_integrator(sys, tol, 4), m_state(sys), m_fallback(true) {
+    // Jorba and Zou's ceil(1 - ln(tol)/2)
+    unsigned int digits = 0;
+    for (scalar t = tol; t < 1 && digits < 10000; t *= 10) {
+      ++digits;
+    }
+    m_degree = std::max(23*digits/20 + 2, 2U);
+  }
+
+  Taylor_integrator::~Taylor_integrator() { }
+
+  unsigned int Taylor_integrator::order() const { return m_degree; }
+
+  void Taylor_integrator::order(unsigned int order) {
+    m_degree = std::max(order, 2U);
+  }
+
+  scalar_time Taylor_integrator::step(const scalar_time& dt,
+                                      scalar_time& elapsed) {
+    if (!m_state.expand(m_degree)) {
+      if (!m_fallback) {
+        apply();
+        m_fallback = true;
+      }
+      return adaptive_step(dt, elapsed, m_tableau);
+    }
+    m_fallback = false;
+
+    // The term of degree j is x[j]*h^j, so it reaches the tolerance at
+    // h = |x[j]|^(-1/j). Looking at two terms guards against series with
+    // only odd or even terms.
+    scalar h = 0, hj, e;
+    bool bounded = false;
+    for (unsigned int j = m_degree - 1; j <= m_degree; ++j) {
+      norm().clear();
+      m_state.error(j, norm());
+      e = norm().value();
+      if (sgn(e) != 0) {
+        hj = pow(e, -scalar(1)/j);
+        h = bounded ? std::min(h, hj) : hj;
+        bounded = true;
+      }
+    }
+
+    scalar_time deltaprime = dt;
+    if (bounded) {
+      deltaprime = convert<scalar_time>(controller()->safety()*h);
+    }
+    scalar_time delta = std::min(dt, deltaprime);
+
+    m_state.evaluate(convert<scalar>(delta));
+    sys().collision();
+
+    elapsed += delta;
+    return deltaprime;
+  }
+
+  multirate_integrator::multirate_integrator(system& sys, const scalar& tol)
+    : integrator(sys), m_state(sys), m_norm(tol), m_levels(16) {
+    // c[i] is the sum of row i of the a-values
+    m_c.resize(m_tableau.stages(), scalar(0));
+    for (unsigned int i = 1; i < m_c.size(); ++i) {
+      for (unsigned int j = 0; j < m_tableau.a()[i - 1].size(); ++j) {
+        m_c[i] += m_tableau.a()[i - 1][j];
+      }
+    }
+    m_tableau.dense(1, m_b1);
+    synchronize();
+  }
+
+  multirate_integrator::~multirate_integrator() { }
+
+  error_norm&       multirate_integrator::norm()       { return m_norm; }
+  const error_norm& multirate_integrator::norm() const { return m_norm; }
+
+  unsigned int multirate_integrator::levels() const { return m_levels; }
+
+  void multirate_integrator::levels(unsigned int levels) {
+    m_levels = std::min(levels, 30U);
+    for (unsigned int i = 0; i < m_level.size(); ++i) {
+      m_level[i] = std::min(m_level[i], m_levels);
+    }
+  }
+
+  unsigned int multirate_integrator::level(unsigned int i) const {
+    return m_level.at(i);
+  }
+
+  scalar_time multirate_integrator::step(const scalar_time& dt,
+                                         scalar_time& elapsed) {
+    unsigned long ticks = 1UL << m_levels;
+    m_unit = convert<scalar>(dt)/ticks;
+    for (unsigned int i = 0; i < m_tick.size(); ++i) {
+      m_tick[i] = 0;
+      if (!m_pieces[i].empty()) {
+        m_last[i].y.swap(m_pieces[i].back().y);
+        m_last[i].k.swap(m_pieces[i].back().k);
+        m_last[i].h = m_pieces[i].back().h;
+        m_pieces[i].clear();
+      }
+      // Bodies which have gained or lost particles start afresh
+      if (m_last[i].y.size() != m_y[i].size()) {
+        m_last[i].y.clear();
+        m_last[i].k.clear();
+      }
+    }
+
+    std::vector<unsigned int> group;
+    while (true) {
+      // The next bodies to step: those whose steps end first, and of those,
+      // the ones whose steps are shortest
+      unsigned long begin = 0, end = 0;
+      group.clear();
+      for (unsigned int i = 0; i < m_tick.size(); ++i) {
+        if (m_tick[i] == ticks) {
+          continue;
+        }
+
+        unsigned long e = m_tick[i] + (ticks >> m_level[i]);
+        if (group.empty() || e < end || (e == end && m_tick[i] > begin)) {
+          group.clear();
+          begin = m_tick[i];
+          end = e;
+        }
+        if (e == end && m_tick[i] == begin) {
+          group.push_back(i);
+        }
+      }
+
+      if (group.empty()) {
+        break;
+      }
+
+      if (advance(group, begin, end)) {
+        // Nobody looks back before the earliest body's tick again, but the
+        // last step is kept for extrapolation
+        unsigned long earliest = ticks;
+        for (unsigned int i = 0; i < m_tick.size(); ++i) {
+          earliest = std::min(earliest, m_tick[i]);
+        }
+        for (unsigned int i = 0; i < m_pieces.size(); ++i) {
+          while (m_pieces[i].size() > 1
+                 && m_pieces[i].front().end <= earliest) {
+            m_pieces[i].pop_front();
+          }
+        }
+      }
+    }
+
+    for (unsigned int i = 0; i < m_y.size(); ++i) {
+      std::copy(m_y[i].begin(), m_y[i].end(),
+                &m_Y[0] + m_state.offset(i));
+    }
+    m_state.scatter(m_Y);
+    sys().collision();
+    synchronize();
+
+    elapsed += dt;
+    return dt;
+  }
+
+  void multirate_integrator::synchronize() {
+    m_state.gather(m_Y);
+    m_dY.resize(m_Y.size());
+    m_e.resize(m_Y.size());
+    m_state.derivative(m_Y, m_dY);
+
+    // Bodies added since the last step start at level 0
+    std::size_t n = sys().size();
+    m_level.resize(n, 0);
+    m_tick.resize(n, 0);
+    m_y.resize(n);
+    m_f.resize(n);
+    m_pieces.resize(n);
+    m_last.resize(n);
+    m_active.resize(n, false);
+    for (unsigned int i = 0; i < n; ++i) {
+      m_y[i].assign(&m_Y[0] + m_state.offset(i),
+                    &m_Y[0] + m_state.offset(i + 1));
+      m_f[i].assign(&m_dY[0] + m_state.offset(i),
+                    &m_dY[0] + m_state.offset(i + 1));
+    }
+  }
+
+  bool multirate_integrator::advance(const std::vector<unsigned int>& group,
+                                     unsigned long begin, unsigned long end) {
+    const a_vector& a = m_tableau.a();
+    const b_vector& b = m_tableau.b();
+    const b_vector& bstar = m_tableau.bstar();
+    unsigned int stages = m_tableau.stages();
+    scalar h = m_unit*(end - begin), t;
+
+    m_steps.resize(group.size());
+    for (unsigned int g = 0; g < group.size(); ++g) {
+      unsigned int i = group[g];
+      m_active[i] = true;
+      m_steps[g].begin = begin;
+      m_steps[g].end = end;
+      m_steps[g].y = m_y[i];
+      m_steps[g].k.resize(stages*m_y[i].size());
+      std::copy(m_f[i].begin(), m_f[i].end(), &m_steps[g].k[0]);
+    }
+
+    for (unsigned int s = 1; s < stages; ++s) {
+      t = m_c[s]*(end - begin);
+      t += begin;
+      for (unsigned int i = 0; i < m_y.size(); ++i) {
+        if (!m_active[i]) {
+          position(i, t);
+        }
+      }
+
+      for (unsigned int g = 0; g < group.size(); ++g) {
+        const piece& p = m_steps[g];
+        std::size_t d = p.y.size(), offset = m_state.offset(group[g]);
+        for (std::size_t j = 0; j < d; ++j) {
+          scalar& y = m_Y[offset + j];
+          y = 0;
+          for (unsigned int r = 0; r < s; ++r) {
+            if (sgn(a[s - 1][r]) != 0) {
+              y.addmul(a[s - 1][r], p.k[r*d + j]);
+            }
+          }
+          y *= h;
+          y += p.y[j];
+        }
+      }
+
+      m_state.scatter(m_Y);
+      for (unsigned int g = 0; g < group.size(); ++g) {
+        std::size_t d = m_steps[g].y.size(), offset = m_state.offset(group[g]);
+        m_state.derivative(group[g], m_Y, m_dY);
+        std::copy(&m_dY[0] + offset, &m_dY[0] + offset + d,
+                  &m_steps[g].k[0] + s*d);
+      }
+    }
+
+    // Each body's error, from the difference between the embeded steps. A
+    // body whose step fails is refined by as many levels as its error asks.
+    std::vector<scalar> err(group.size(), scalar(0));
+    bool rejected = false;
+    for (unsigned int g = 0; g < group.size(); ++g) {
+      const piece& p = m_steps[g];
+      std::size_t d = p.y.size(), offset = m_state.offset(group[g]);
+      for (std::size_t j = 0; j < d; ++j) {
+        scalar& e = m_e[offset + j];
+        e = 0;
+        for (unsigned int r = 0; r < stages; ++r) {
+          e.addmul(b[r] - bstar[r], p.k[r*d + j]);
+        }
+        e *= h;
+      }
+
+      m_norm.clear();
+      m_state.error(group[g], m_Y, m_e, m_norm);
+      err[g] = m_norm.value();
+
+      // Halving the step divides a fifth-order local error by 32
+      unsigned int& l = m_level[group[g]];
+      for (scalar r = err[g]; r > 1 && l < m_levels; r /= 32) {
+        ++l;
+        rejected = true;
+      }
+    }
+
+    for (unsigned int g = 0; g < group.size(); ++g) {
+      m_active[group[g]] = false;
+    }
+    if (rejected) {
+      return false;
+    }
+
+    for (unsigned int g = 0; g < group.size(); ++g) {
+      unsigned int i = group[g];
+      std::size_t d = m_y[i].size(), offset = m_state.offset(i);
+
+      // The last stage is evaluated at the new state (FSAL), so the new state
+      // is still in m_Y and the last derivative is the one there
+      std::copy(&m_Y[0] + offset, &m_Y[0] + offset + d,
+                m_y[i].begin());
+      std::copy(&m_steps[g].k[0] + (stages - 1)*d, &m_steps[g].k[0] + stages*d,
+                m_f[i].begin());
+      m_tick[i] = end;
+      m_pieces[i].push_back(piece());
+      m_pieces[i].back().begin = begin;
+      m_pieces[i].back().end = end;
+      m_pieces[i].back().h = h;
+      m_pieces[i].back().y.swap(m_steps[g].y);
+      m_pieces[i].back().k.swap(m_steps[g].k);
+
+      // Doubling the step is safe if the error would stay well within
+      // tolerance, and the doubled step stays aligned to its own size
+      if (m_level[i] > 0 && err[g] < scalar(1)/64
+          && end % (2*(end - begin)) == 0) {
+        --m_level[i];
+      }
+    }
+
+    return true;
+  }
+
+  void multirate_integrator::position(unsigned int i, const scalar& t) {
+    scalar* y = &m_Y[0] + m_state.offset(i);
+    const std::deque<piece>& pieces = m_pieces[i];
+
+    if (t == m_tick[i]) {
+      std::copy(m_y[i].begin(), m_y[i].end(), y);
+      return;
+    }
+
+    // The step containing t, or the last one before it
+    const piece* p;
+    scalar theta;
+    if (!pieces.empty()) {
+      std::deque<piece>::const_iterator q = pieces.end();
+      --q;
+      while (q != pieces.begin() && q->begin > t) {
+        --q;
+      }
+      p = &*q;
+      theta = (t - p->begin)/(p->end - p->begin);
+    } else if (!m_last[i].k.empty()) {
+      // The body hasn't stepped yet in this call, so m_tick[i] is 0
+      p = &m_last[i];
+      theta = m_unit*t/p->h + 1;
+    } else {
+      // Linearly from the derivative
+      scalar h = m_unit*(t - m_tick[i]);
+      for (std::size_t j = 0; j < m_y[i].size(); ++j, ++y) {
+        *y = m_y[i][j];
+        y->addmul(h, m_f[i][j]);
+      }
+      return;
+    }
+
+    m_tableau.dense(theta, m_b);
+    bool past = theta > 1;
+    if (past) {
+      // From the end of the step, where the body is now
+      for (unsigned int r = 0; r < m_b.size(); ++r) {
+        m_b[r] -= m_b1[r];
+      }
+    }
+    const state_vector& y0 = past ? m_y[i] : p->y;
+
+    std::size_t d = p->y.size();
+    for (std::size_t j = 0; j < d; ++j, ++y) {
+      *y = 0;
+      for (unsigned int r = 0; r < m_b.size(); ++r) {
+        y->addmul(m_b[r], p->k[r*d + j]);
+      }
+      *y *= p->h;
+      *y += y0[j];
+    }
+  }
+
+  Hermite_integrator::Hermite_integrator(system& sys, const scalar& eta)
+    : simple_integrator(sys), m_eta(eta), m_levels(16), m_fallback(true) { }
+
+  Hermite_integrator::~Hermite_integrator() { }
+
+  scalar Hermite_integrator::eta() const { return m_eta; }
+  void Hermite_integrator::eta(const scalar& eta) { m_eta = eta; }
+
+  unsigned int Hermite_integrator::levels() const { return m_levels; }
+
+  void Hermite_integrator::levels(unsigned int levels) {
+    m_levels = std::min(levels, 30U);
+  }
+
+  scalar_time Hermite_integrator::step(const scalar_time& dt,
+                                       scalar_time& elapsed) {
+    scalar H = convert<scalar>(dt);
+    if (!start(H)) {
+      if (!m_fallback) {
+        apply();
+        m_fallback = true;
+      }
+      return simple_step(dt, elapsed, m_tableau);
+    }
+    m_fallback = false;
+
+    unsigned long ticks = 1UL << m_levels;
+    scalar unit = H/ticks;
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      m_tick[i] = 0;
+      m_level[i] = 0;
+      while (m_level[i] < m_levels && unit*(ticks >> m_level[i]) > m_step[i]) {
+        ++m_level[i];
+      }
+    }
+
+    unsigned long next = 0;
+    while (next < ticks) {
+      next = ticks;
+      for (unsigned int i = 0; i < m_particles.size(); ++i) {
+        next = std::min(next, m_tick[i] + (ticks >> m_level[i]));
+      }
+
+      for (unsigned int i = 0; i < m_particles.size(); ++i) {
+        predict(i, unit*(next - m_tick[i]));
+      }
+
+      // Every particle due is evaluated at the predicted state before any
+      // of them is corrected
+      for (unsigned int i = 0; i < m_particles.size(); ++i) {
+        if (m_tick[i] + (ticks >> m_level[i]) == next) {
+          evaluate(i, m_a1, m_j1);
+        }
+      }
+
+      for (unsigned int i = 0; i < m_particles.size(); ++i) {
+        unsigned long span = ticks >> m_level[i];
+        if (m_tick[i] + span != next) {
+          continue;
+        }
+
+        m_step[i] = correct(i, unit*span);
+        m_tick[i] = next;
+
+        // Steps may shrink at any time, but only grow one level at a time,
+        // where the doubled step is aligned to its own size
+        unsigned int l = 0;
+        while (l < m_levels && unit*(ticks >> l) > m_step[i]) {
+          ++l;
+        }
+        if (l > m_level[i]) {
+          m_level[i] = l;
+        } else if (l < m_level[i] && m_level[i] > 0
+                   && next%(2*span) == 0) {
+          --m_level[i];
+        }
+      }
+    }
+
+    sys().collision();
+
+    elapsed += dt;
+    return dt;
+  }
+
+  bool Hermite_integrator::start(const scalar& dt) {
+    std::size_t n = 0;
+    for (system::iterator b = sys().begin(); b != sys().end(); ++b) {
+      if (!dynamic_cast<simple_body*>(&*b)) {
+        return false;
+      }
+      n += b->size();
+    }
+
+    // The particles may have changed; if so, start again from Aarseth's
+    // starting criterion
+    bool fresh = n != m_particles.size();
+    m_particles.resize(n);
+    m_s.resize(3*n, scalar(0));
+    m_v.resize(3*n, scalar(0));
+    m_a.resize(3*n, scalar(0));
+    m_j.resize(3*n, scalar(0));
+    m_a1.resize(3*n, scalar(0));
+    m_j1.resize(3*n, scalar(0));
+    m_tick.resize(n);
+    m_level.resize(n);
+    m_step.resize(n, scalar(0));
+
+    unsigned int i = 0;
+    for (system::iterator b = sys().begin(); b != sys().end(); ++b) {
+      for (body::iterator x = b->begin(); x != b->end(); ++x, ++i) {
+        fresh = fresh || m_particles[i] != &*x;
+        m_particles[i] = &*x;
+        flatten(x->s(), &m_s[3*i]);
+        flatten(x->v(), &m_v[3*i]);
+      }
+    }
+
+    for (i = 0; i < n; ++i) {
+      if (!evaluate(i, m_a, m_j)) {
+        return false;
+      }
+    }
+
+    if (fresh) {
+      scalar a, j;
+      for (i = 0; i < n; ++i) {
+        a = sqrt(m_a[3*i]*m_a[3*i] + m_a[3*i + 1]*m_a[3*i + 1]
+                 + m_a[3*i + 2]*m_a[3*i + 2]);
+        j = sqrt(m_j[3*i]*m_j[3*i] + m_j[3*i + 1]*m_j[3*i + 1]
+                 + m_j[3*i + 2]*m_j[3*i + 2]);
+        if (sgn(j) == 0) {
+          m_step[i] = dt;
+        } else {
+          m_step[i] = m_eta*a/(2*j);
+        }
+      }
+    }
+    return true;
+  }
+
+  bool Hermite_integrator::evaluate(unsigned int i, std::vector<scalar>& a,
+                                    std::vector<scalar>& j) {
+    particle& x = *m_particles[i];
+    x.apply_forces();
+    scalar m = convert<scalar>(x.m());
+
+    flatten(x.F(), &a[3*i]);
+    for (unsigned int k = 0; k < 3; ++k) {
+      a[3*i + k] /= m;
+      j[3*i + k] = 0;
+    }
+    if (!x.jerk(&j[3*i])) {
+      return false;
+    }
+    for (unsigned int k = 0; k < 3; ++k) {
+      j[3*i + k] /= m;
+    }
+    return true;
+  }
+
+  void Hermite_integrator::predict(unsigned int i, const scalar& h) {
+    // s + h*(v + h/2*(a + h/3*j)), and v + h*(a + h/2*j)
+    scalar s[3], v[3];
+    for (unsigned int k = 0; k < 3; ++k) {
+      unsigned int c = 3*i + k;
+      s[k] = m_j[c];
+      s[k] *= h/3;
+      s[k] += m_a[c];
+      s[k] *= h/2;
+      s[k] += m_v[c];
+      s[k] *= h;
+      s[k] += m_s[c];
+
+      v[k] = m_j[c];
+      v[k] *= h/2;
+      v[k] += m_a[c];
+      v[k] *= h;
+      v[k] += m_v[c];
+    }
+
+    vector_displacement sv;
+    vector_velocity vv;
+    unflatten(sv, s);
+    unflatten(vv, v);
+    m_particles[i]->s(sv);
+    m_particles[i]->v(vv);
+  }
+
+  scalar Hermite_integrator::correct(unsigned int i, const scalar& h) {
+    // The snap and crackle at the start of the step that fit the old and new
+    // accelerations and jerks, then the Taylor series to fifth order
+    scalar a2[3], a3[3], da, t;
+    for (unsigned int k = 0; k < 3; ++k) {
+      unsigned int c = 3*i + k;
+      da = m_a[c] - m_a1[c];
+
+      a2[k] = -6*da;
+      t = 4*m_j[c];
+      t += 2*m_j1[c];
+      a2[k].addmul(-h, t);
+      a2[k] /= h*h;
+
+      a3[k] = 12*da;
+      t = m_j[c];
+      t += m_j1[c];
+      a3[k].addmul(6*h, t);
+      a3[k] /= h*h*h;
+
+      // s += h*(v + h/2*(a + h/3*(j + h/4*(a2 + h/5*a3))))
+      t = a3[k];
+      t *= h/5;
+      t += a2[k];
+      t *= h/4;
+      t += m_j[c];
+      t *= h/3;
+      t += m_a[c];
+      t *= h/2;
+      t += m_v[c];
+      m_s[c].addmul(h, t);
+
+      // v += h*(a + h/2*(j + h/3*(a2 + h/4*a3)))
+      t = a3[k];
+      t *= h/4;
+      t += a2[k];
+      t *= h/3;
+      t += m_j[c];
+      t *= h/2;
+      t += m_a[c];
+      m_v[c].addmul(h, t);
+
+      m_a[c] = m_a1[c];
+      m_j[c] = m_j1[c];
+
+      // The snap at the end of the step, for the next step size
+      a2[k].addmul(h, a3[k]);
+    }
+
+    vector_displacement s;
+    vector_velocity v;
+    unflatten(s, &m_s[3*i]);
+    unflatten(v, &m_v[3*i]);
+    m_particles[i]->s(s);
+    m_particles[i]->v(v);
+
+    // Aarseth's criterion,
+    // sqrt(eta*(|a|*|a2| + |j|^2)/(|j|*|a3| + |a2|^2))
+    scalar a = 0, j = 0, s2 = 0, s3 = 0;
+    for (unsigned int k = 0; k < 3; ++k) {
+      a.addmul(m_a[3*i + k], m_a[3*i + k]);
+      j.addmul(m_j[3*i + k], m_j[3*i + k]);
+      s2.addmul(a2[k], a2[k]);
+      s3.addmul(a3[k], a3[k]);
+    }
+    a = sqrt(a);
+    j = sqrt(j);
+    s3 = sqrt(s3);
+
+    scalar den = j*s3 + s2;
+    if (sgn(den) == 0) {
+      return h*(1UL << m_levels); // No limit; at least dt
+    }
+    return sqrt(m_eta*(a*sqrt(s2) + j*j)/den);
+  }
+
+  Wisdom_Holman_integrator::Wisdom_Holman_integrator(system& sys)
+    : simple_integrator(sys), m_central(0), m_forces(false),
+      m_fallback(true) { }
+
+  Wisdom_Holman_integrator::~Wisdom_Holman_integrator() { }
+
+  scalar_time Wisdom_Holman_integrator::step(const scalar_time& dt,
+                                             scalar_time& elapsed) {
+    if (!start()) {
+      if (!m_fallback) {
+        apply();
+        m_fallback = true;
+      }
+      return simple_step(dt, elapsed, m_tableau);
+    }
+    m_fallback = false;
+
+    scalar h = convert<scalar>(dt);
+    kick(h/2);
+    jump(h/2);
+    drift(h);
+    jump(h/2);
+    kick(h/2);
+
+    finish();
+    sys().collision();
+
+    elapsed += dt;
+    return dt;
+  }
+
+  bool Wisdom_Holman_integrator::start() {
+    std::size_t n = 0;
+    for (system::iterator b = sys().begin(); b != sys().end(); ++b) {
+      if (!dynamic_cast<simple_body*>(&*b)) {
+        return false;
+      }
+      n += b->size();
+    }
+
+    bool fresh = n != m_particles.size();
+    m_particles.resize(n);
+    m_orbits.resize(n);
+    m_Q.resize(3*n, scalar(0));
+    m_P.resize(3*n, scalar(0));
+    m_m.resize(n, scalar(0));
+    m_F.resize(3*n, scalar(0));
+
+    unsigned int i = 0;
+    for (system::iterator b = sys().begin(); b != sys().end(); ++b) {
+      for (body::iterator x = b->begin(); x != b->end(); ++x, ++i) {
+        fresh = fresh || m_particles[i] != &*x;
+        m_particles[i] = &*x;
+      }
+    }
+    if (fresh) {
+      m_forces = false;
+    }
+    if (n == 0) {
+      return true;
+    }
+
+    m_M = 0;
+    m_central = 0;
+    for (i = 0; i < n; ++i) {
+      m_m[i] = convert<scalar>(m_particles[i]->m());
+      m_M += m_m[i];
+      if (m_m[i] > m_m[m_central]) {
+        m_central = i;
+      }
+    }
+
+    // The particles held to the central one by its gravity
+    const particle* c = m_particles[m_central];
+    for (i = 0; i < n; ++i) {
+      m_orbits[i] = false;
+      for (particle::const_iterator f = m_particles[i]->begin();
+           i != m_central && f != m_particles[i]->end(); ++f) {
+        const gravitational_force* g
+          = dynamic_cast<const gravitational_force*>(&*f);
+        if (g && &g->source() == c) {
+          m_orbits[i] = true;
+        }
+      }
+    }
+
+    // Center of mass and total momentum, then positions relative to the
+    // central particle and momenta relative to the center of mass
+    scalar s[3], p[3], V[3];
+    scalar* Q = &m_Q[3*m_central];
+    scalar* P = &m_P[3*m_central];
+    for (unsigned int k = 0; k < 3; ++k) {
+      Q[k] = 0;
+      P[k] = 0;
+    }
+    for (i = 0; i < n; ++i) {
+      flatten(m_particles[i]->s(), s);
+      flatten(m_particles[i]->p(), p);
+      for (unsigned int k = 0; k < 3; ++k) {
+        Q[k].addmul(m_m[i], s[k]);
+        P[k] += p[k];
+      }
+    }
+    for (unsigned int k = 0; k < 3; ++k) {
+      Q[k] /= m_M;
+      V[k] = P[k]/m_M;
+    }
+
+    flatten(c->s(), s);
+    for (i = 0; i < n; ++i) {
+      if (i != m_central) {
+        flatten(m_particles[i]->s(), &m_Q[3*i]);
+        flatten(m_particles[i]->p(), &m_P[3*i]);
+        for (unsigned int k = 0; k < 3; ++k) {
+          m_Q[3*i + k] -= s[k];
+          m_P[3*i + k].addmul(-m_m[i], V[k]);
+        }
+      }
+    }
+    return true;
+  }
+
+  void Wisdom_Holman_integrator::finish() {
+    if (m_particles.empty()) {
+      return;
+    }
+
+    // The central particle sits where it keeps the center of mass in place,
+    // and takes up what's left of the momentum
+    scalar s0[3], p0[3], V[3];
+    const scalar* Q = &m_Q[3*m_central];
+    const scalar* P = &m_P[3*m_central];
+    for (unsigned int k = 0; k < 3; ++k) {
+      s0[k] = 0;
+      V[k] = P[k]/m_M;
+      p0[k] = m_m[m_central]*V[k];
+    }
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      if (i != m_central) {
+        for (unsigned int k = 0; k < 3; ++k) {
+          s0[k].addmul(m_m[i], m_Q[3*i + k]);
+          p0[k] -= m_P[3*i + k];
+        }
+      }
+    }
+    for (unsigned int k = 0; k < 3; ++k) {
+      s0[k] /= -m_M;
+      s0[k] += Q[k];
+    }
+
+    vector_displacement s;
+    vector_momentum p;
+    scalar si[3], pi[3];
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      if (i == m_central) {
+        unflatten(s, s0);
+        unflatten(p, p0);
+      } else {
+        for (unsigned int k = 0; k < 3; ++k) {
+          si[k] = m_Q[3*i + k];
+          si[k] += s0[k];
+          pi[k] = m_P[3*i + k];
+          pi[k].addmul(m_m[i], V[k]);
+        }
+        unflatten(s, si);
+        unflatten(p, pi);
+      }
+      m_particles[i]->s(s);
+      m_particles[i]->p(p);
+    }
+  }
+
+  void Wisdom_Holman_integrator::kick(const scalar& h) {
+    if (!m_forces) {
+      // Every force but the central particle's gravity, which the drift
+      // takes care of
+      finish();
+      const particle* c = m_particles.empty() ? 0 : m_particles[m_central];
+      for (unsigned int i = 0; i < m_particles.size(); ++i) {
+        if (i == m_central) {
+          continue;
+        }
+
+        particle& x = *m_particles[i];
+        vector_force F = 0;
+        for (particle::const_iterator f = x.begin(); f != x.end(); ++f) {
+          const gravitational_force* g
+            = dynamic_cast<const gravitational_force*>(&*f);
+          if (!g || &g->source() != c) {
+            F += f->force(x);
+          }
+        }
+        flatten(F, &m_F[3*i]);
+      }
+      m_forces = true;
+    }
+
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      if (i != m_central) {
+        for (unsigned int k = 0; k < 3; ++k) {
+          m_P[3*i + k].addmul(h, m_F[3*i + k]);
+        }
+      }
+    }
+  }
+
+  void Wisdom_Holman_integrator::jump(const scalar& h) {
+    // Q += h*sum(P)/m0
+    if (m_particles.empty()) {
+      return;
+    }
+
+    scalar P[3];
+    for (unsigned int k = 0; k < 3; ++k) {
+      P[k] = 0;
+    }
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      if (i != m_central) {
+        for (unsigned int k = 0; k < 3; ++k) {
+          P[k] += m_P[3*i + k];
+        }
+      }
+    }
+
+    scalar c = h/m_m[m_central];
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      if (i != m_central) {
+        for (unsigned int k = 0; k < 3; ++k) {
+          m_Q[3*i + k].addmul(c, P[k]);
+        }
+      }
+    }
+  }
+
+  void Wisdom_Holman_integrator::drift(const scalar& h) {
+    if (m_particles.empty()) {
+      return;
+    }
+
+    scalar mu = convert<scalar>(gravitational_force::G())*m_m[m_central];
+    scalar v[3];
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      scalar c = h/(i == m_central ? m_M : m_m[i]);
+      if (m_orbits[i]) {
+        for (unsigned int k = 0; k < 3; ++k) {
+          v[k] = m_P[3*i + k]/m_m[i];
+        }
+        kepler(&m_Q[3*i], v, mu, h);
+        for (unsigned int k = 0; k < 3; ++k) {
+          m_P[3*i + k] = m_m[i]*v[k];
+        }
+      } else {
+        for (unsigned int k = 0; k < 3; ++k) {
+          m_Q[3*i + k].addmul(c, m_P[3*i + k]);
+        }
+      }
+    }
+    m_forces = false;
+  }
+
+  void stumpff(const scalar& z, scalar* c) {
+    // Quarter z until the series converge quickly, then build back up with
+    // c0(4z) = 2*c0(z)^2 - 1, c1(4z) = c0(z)*c1(z), c2(4z) = c1(z)^2/2, and
+    // c3(4z) = (c2(z) + c0(z)*c3(z))/4
+    scalar x = z;
+    unsigned int n = 0;
+    while (abs(x) > scalar("0.1")) {
+      x /= 4;
+      ++n;
+    }
+
+    scalar eps = pow(scalar(2), -scalar(precision() + 2));
+    scalar t2 = scalar(1)/2, t3 = scalar(1)/6;
+    c[2] = 0;
+    c[3] = 0;
+    for (unsigned int k = 1; abs(t2) > eps || abs(t3) > eps; ++k) {
+      c[2] += t2;
+      c[3] += t3;
+      t2 *= -x/((2*k + 1)*(2*k + 2));
+      t3 *= -x/((2*k + 2)*(2*k + 3));
+    }
+    c[0] = 1 - x*c[2];
+    c[1] = 1 - x*c[3];
+
+    while (n-- > 0) {
+      c[3] = (c[2] + c[0]*c[3])/4;
+      c[2] = c[1]*c[1]/2;
+      c[1] *= c[0];
+      c[0] = 2*c[0]*c[0] - 1;
+    }
+  }
+
+  void kepler(scalar* r, scalar* v, const scalar& mu, const scalar& h) {
+    // With G[k](X) = X^k*c[k](beta*X^2), the universal anomaly X solves
+    // r0*X + eta*G[2] + zeta*G[3] = h
+    scalar r0 = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+    if (sgn(r0) == 0) {
+      return;
+    }
+    scalar eta = r[0]*v[0] + r[1]*v[1] + r[2]*v[2];
+    scalar beta = 2*mu/r0 - (v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    scalar zeta = mu - beta*r0;
+
+    // Laguerre-Conway iteration, which converges from the first guess h/r0
+    // even for very eccentric orbits
+    scalar eps = pow(scalar(2), 8 - scalar(precision()));
+    scalar X = h/r0, dX, f, df, d2f, c[4], G[4];
+    for (unsigned int i = 0; i < 100; ++i) {
+      stumpff(beta*X*X, c);
+      G[0] = c[0];
+      G[1] = X*c[1];
+      G[2] = X*X*c[2];
+      G[3] = X*X*X*c[3];
+
+      f = r0*X + eta*G[2] + zeta*G[3] - h;
+      df = r0 + eta*G[1] + zeta*G[2];
+      d2f = eta*G[0] + zeta*G[1];
+
+      // n = 5: X -= n*f/(df +- sqrt((n - 1)^2*df^2 - n*(n - 1)*f*d2f))
+      dX = 5*f/(df + sgn(df)*sqrt(abs(16*df*df - 20*f*d2f)));
+      X -= dX;
+      if (abs(dX) <= eps*abs(X)) {
+        break;
+      }
+    }
+
+    stumpff(beta*X*X, c);
+    G[0] = c[0];
+    G[1] = X*c[1];
+    G[2] = X*X*c[2];
+    G[3] = X*X*X*c[3];
+    scalar r1 = r0 + eta*G[1] + zeta*G[2];
+
+    // Gauss's f and g functions
+    scalar F = 1 - mu*G[2]/r0, g = h - mu*G[3];
+    scalar dF = -mu*G[1]/(r0*r1), dg = 1 - mu*G[2]/r1;
+    scalar ri;
+    for (unsigned int k = 0; k < 3; ++k) {
+      ri = r[k];
+      r[k] = F*ri + g*v[k];
+      v[k] = dF*ri + dg*v[k];
+    }
+  }
+
+  void KS_kepler(scalar* r, scalar* v, const scalar& mu, const scalar& h) {
+    // r = L(u)*u, with |r| = u.u
+    scalar r0 = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+    if (sgn(r0) == 0) {
+      return;
+    }
+    scalar u[4];
+    if (sgn(r[0]) >= 0) {
+      u[0] = sqrt((r0 + r[0])/2);
+      u[1] = r[1]/(2*u[0]);
+      u[2] = r[2]/(2*u[0]);
+      u[3] = 0;
+    } else {
+      u[1] = sqrt((r0 - r[0])/2);
+      u[0] = r[1]/(2*u[1]);
+      u[3] = r[2]/(2*u[1]);
+      u[2] = 0;
+    }
+
+    // du/ds = L(u)^T*v/2
+    scalar du[4];
+    du[0] = ( u[0]*v[0] + u[1]*v[1] + u[2]*v[2])/2;
+    du[1] = (-u[1]*v[0] + u[0]*v[1] + u[3]*v[2])/2;
+    du[2] = (-u[2]*v[0] - u[3]*v[1] + u[0]*v[2])/2;
+    du[3] = ( u[3]*v[0] - u[2]*v[1] + u[1]*v[2])/2;
+
+    // u'' = -alpha*u, with alpha = -E/2 and E = (2*|u'|^2 - mu)/r
+    scalar du2 = du[0]*du[0] + du[1]*du[1] + du[2]*du[2] + du[3]*du[3];
+    scalar alpha = (mu - 2*du2)/(2*r0);
+    scalar eta = 2*(u[0]*du[0] + u[1]*du[1] + u[2]*du[2] + u[3]*du[3]);
+    scalar zeta = 2*du2 - 2*alpha*r0;
+
+    // t(s) = integral of u.u ds = r0*s + eta*G[2] + zeta*G[3], with
+    // G[k](s) = s^k*c[k](4*alpha*s^2), which grows monotonically
+    scalar eps = pow(scalar(2), 8 - scalar(precision()));
+    scalar s = h/r0, ds, f, df, d2f, c[4], G[4];
+    for (unsigned int i = 0; i < 100; ++i) {
+      stumpff(4*alpha*s*s, c);
+      G[0] = c[0];
+      G[1] = s*c[1];
+      G[2] = s*s*c[2];
+      G[3] = s*s*s*c[3];
+
+      f = r0*s + eta*G[2] + zeta*G[3] - h;
+      df = r0 + eta*G[1] + zeta*G[2];
+      d2f = eta*G[0] + zeta*G[1];
+
+      // Laguerre-Conway, as in kepler()
+      ds = 5*f/(df + sgn(df)*sqrt(abs(16*df*df - 20*f*d2f)));
+      s -= ds;
+      if (abs(ds) <= eps*abs(s)) {
+        break;
+      }
+    }
+
+    // u(s) = u*c[0](alpha*s^2) + u'*s*c[1](alpha*s^2)
+    stumpff(alpha*s*s, c);
+    scalar S = s*c[1], ui;
+    for (unsigned int k = 0; k < 4; ++k) {
+      ui = u[k];
+      u[k] = c[0]*ui + S*du[k];
+      du[k] = c[0]*du[k] - alpha*S*ui;
+    }
+
+    // r = L(u)*u, v = 2*L(u)*u'/|r|
+    scalar r1 = u[0]*u[0] + u[1]*u[1] + u[2]*u[2] + u[3]*u[3];
+    r[0] = u[0]*u[0] - u[1]*u[1] - u[2]*u[2] + u[3]*u[3];
+    r[1] = 2*(u[0]*u[1] - u[2]*u[3]);
+    r[2] = 2*(u[0]*u[2] + u[1]*u[3]);
+    v[0] = 2*(u[0]*du[0] - u[1]*du[1] - u[2]*du[2] + u[3]*du[3])/r1;
+    v[1] = 2*(u[1]*du[0] + u[0]*du[1] - u[3]*du[2] - u[2]*du[3])/r1;
+    v[2] = 2*(u[2]*du[0] + u[3]*du[1] + u[0]*du[2] + u[1]*du[3])/r1;
+  }
+
+  KS_integrator::KS_integrator(system& sys)
+    : simple_integrator(sys), m_forces(false), m_eta(16), m_fallback(true)
+  { }
+
+  KS_integrator::~KS_integrator() { }
+
+  scalar KS_integrator::eta() const { return m_eta; }
+  void KS_integrator::eta(const scalar& eta) { m_eta = eta; }
+
+  scalar_time KS_integrator::step(const scalar_time& dt,
+                                  scalar_time& elapsed) {
+    scalar h = convert<scalar>(dt);
+    if (!start(h)) {
+      if (!m_fallback) {
+        apply();
+        m_fallback = true;
+      }
+      return simple_step(dt, elapsed, m_tableau);
+    }
+    m_fallback = false;
+
+    // The pairs orbit in the field of the rest at the middle of the step
+    kick(h/2);
+    drift(h/2);
+    finish();
+    orbit(h);
+    drift(h/2);
+    m_forces = false;
+    kick(h/2);
+
+    finish();
+    sys().collision();
+
+    elapsed += dt;
+    return dt;
+  }
+
+  bool KS_integrator::start(const scalar& h) {
+    std::size_t n = 0;
+    for (system::iterator b = sys().begin(); b != sys().end(); ++b) {
+      if (!dynamic_cast<simple_body*>(&*b)) {
+        return false;
+      }
+      n += b->size();
+    }
+
+    bool fresh = n != m_particles.size();
+    m_particles.resize(n);
+    m_partner.resize(n);
+    m_s.resize(3*n, scalar(0));
+    m_v.resize(3*n, scalar(0));
+    m_m.resize(n, scalar(0));
+    m_F.resize(3*n, scalar(0));
+
+    unsigned int i = 0;
+    for (system::iterator b = sys().begin(); b != sys().end(); ++b) {
+      for (body::iterator x = b->begin(); x != b->end(); ++x, ++i) {
+        fresh = fresh || m_particles[i] != &*x;
+        m_particles[i] = &*x;
+        m_m[i] = convert<scalar>(x->m());
+        flatten(x->s(), &m_s[3*i]);
+        flatten(x->v(), &m_v[3*i]);
+      }
+    }
+
+    // Pair the particles greedily, shortest dynamical time first; the
+    // squared times are compared to (eta*h)^2
+    std::vector<unsigned int> partner(n);
+    for (i = 0; i < n; ++i) {
+      partner[i] = i;
+    }
+    scalar G = convert<scalar>(gravitational_force::G());
+    scalar limit = m_eta*h*m_eta*h, t2, best, d;
+    while (true) {
+      unsigned int bi = 0, bj = 0;
+      for (i = 0; i < n; ++i) {
+        for (unsigned int j = i + 1; partner[i] == i && j < n; ++j) {
+          if (partner[j] != j || !attracts(*m_particles[i], *m_particles[j])
+              || !attracts(*m_particles[j], *m_particles[i])) {
+            continue;
+          }
+
+          t2 = 0;
+          for (unsigned int k = 0; k < 3; ++k) {
+            d = m_s[3*j + k] - m_s[3*i + k];
+            t2.addmul(d, d);
+          }
+          t2 *= sqrt(t2);
+          t2 /= G*(m_m[i] + m_m[j]);
+          if (t2 < limit && (bi == bj || t2 < best)) {
+            best = t2;
+            bi = i;
+            bj = j;
+          }
+        }
+      }
+      if (bi == bj) {
+        break;
+      }
+      partner[bi] = bj;
+      partner[bj] = bi;
+    }
+
+    // The kicks leave out the pairs' mutual gravity, so they change with
+    // the pairs
+    if (fresh || partner != m_partner) {
+      m_partner.swap(partner);
+      m_forces = false;
+    }
+    return true;
+  }
+
+  void KS_integrator::finish() {
+    vector_displacement s;
+    vector_velocity v;
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      unflatten(s, &m_s[3*i]);
+      unflatten(v, &m_v[3*i]);
+      m_particles[i]->s(s);
+      m_particles[i]->v(v);
+    }
+  }
+
+  void KS_integrator::kick(const scalar& h) {
+    if (!m_forces) {
+      finish();
+      for (unsigned int i = 0; i < m_particles.size(); ++i) {
+        force(i, &m_F[3*i]);
+      }
+      m_forces = true;
+    }
+
+    // A pair's center of mass feels the sum of the forces on it; the
+    // difference is left to orbit()
+    scalar c, F;
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      unsigned int j = m_partner[i];
+      c = h/(m_m[i] + m_m[j]); // h/(2*m) for a single particle
+      for (unsigned int k = 0; k < 3; ++k) {
+        F = m_F[3*i + k] + m_F[3*j + k];
+        m_v[3*i + k].addmul(c, F);
+      }
+    }
+  }
+
+  void KS_integrator::drift(const scalar& h) {
+    scalar c, V;
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      unsigned int j = m_partner[i];
+      c = m_m[j]/(m_m[i] + m_m[j]);
+      for (unsigned int k = 0; k < 3; ++k) {
+        // The center of mass's velocity, which is v for a single particle
+        V = m_v[3*i + k];
+        V.addmul(c, m_v[3*j + k] - m_v[3*i + k]);
+        m_s[3*i + k].addmul(h, V);
+      }
+    }
+  }
+
+  void KS_integrator::orbit(const scalar& h) {
+    scalar G = convert<scalar>(gravitational_force::G());
+    scalar M, mu, E, T, R[3], V[3], r[3], v[3], P[3];
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      unsigned int j = m_partner[i];
+      if (j <= i) {
+        continue; // A single particle, or done with i's partner
+      }
+
+      scalar* si = &m_s[3*i];
+      scalar* sj = &m_s[3*j];
+      scalar* vi = &m_v[3*i];
+      scalar* vj = &m_v[3*j];
+      M = m_m[i] + m_m[j];
+      mu = G*M;
+      for (unsigned int k = 0; k < 3; ++k) {
+        R[k] = si[k];
+        R[k].addmul(m_m[j]/M, sj[k] - si[k]);
+        V[k] = vi[k];
+        V[k].addmul(m_m[j]/M, vj[k] - vi[k]);
+        r[k] = sj[k] - si[k];
+        v[k] = vj[k] - vi[k];
+      }
+
+      // Enough substeps that the perturbations are followed eta() times per
+      // dynamical time sqrt(a^3/mu) of the relative orbit
+      E = (v[0]*v[0] + v[1]*v[1] + v[2]*v[2])/2
+        - mu/sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+      T = abs(mu/(2*E));
+      T = sqrt(T*T*T/mu);
+      unsigned int n = 1;
+      while (n < (1U << 20) && T*n < m_eta*h) {
+        n *= 2;
+      }
+      scalar dh = h/n;
+
+      perturbation(i, R, V, r, v, P);
+      for (unsigned int l = 0; l < n; ++l) {
+        for (unsigned int k = 0; k < 3; ++k) {
+          v[k].addmul(dh/2, P[k]);
+        }
+        KS_kepler(r, v, mu, dh);
+        perturbation(i, R, V, r, v, P);
+        for (unsigned int k = 0; k < 3; ++k) {
+          v[k].addmul(dh/2, P[k]);
+        }
+      }
+
+      for (unsigned int k = 0; k < 3; ++k) {
+        si[k] = R[k];
+        si[k].addmul(-m_m[j]/M, r[k]);
+        sj[k] = R[k];
+        sj[k].addmul(m_m[i]/M, r[k]);
+        vi[k] = V[k];
+        vi[k].addmul(-m_m[j]/M, v[k]);
+        vj[k] = V[k];
+        vj[k].addmul(m_m[i]/M, v[k]);
+      }
+    }
+  }
+
+  void KS_integrator::force(unsigned int i, scalar* F) {
+    particle& x = *m_particles[i];
+    const particle* y = m_particles[m_partner[i]];
+    vector_force f = 0;
+    for (particle::const_iterator g = x.begin(); g != x.end(); ++g) {
+      const gravitational_force* gravity
+        = dynamic_cast<const gravitational_force*>(&*g);
+      if (!gravity || &gravity->source() != y) {
+        f += g->force(x);
+      }
+    }
+    flatten(f, F);
+  }
+
+  void KS_integrator::perturbation(unsigned int i, const scalar* R,
+                                   const scalar* V, const scalar* r,
+                                   const scalar* v, scalar* P) {
+    unsigned int j = m_partner[i];
+    scalar M = m_m[i] + m_m[j];
+    scalar s[3], u[3], Fi[3], Fj[3];
+    vector_displacement sv;
+    vector_velocity uv;
+    for (unsigned int k = 0; k < 3; ++k) {
+      s[k] = R[k];
+      s[k].addmul(-m_m[j]/M, r[k]);
+      u[k] = V[k];
+      u[k].addmul(-m_m[j]/M, v[k]);
+    }
+    unflatten(sv, s);
+    unflatten(uv, u);
+    m_particles[i]->s(sv);
+    m_particles[i]->v(uv);
+    for (unsigned int k = 0; k < 3; ++k) {
+      s[k] = R[k];
+      s[k].addmul(m_m[i]/M, r[k]);
+      u[k] = V[k];
+      u[k].addmul(m_m[i]/M, v[k]);
+    }
+    unflatten(sv, s);
+    unflatten(uv, u);
+    m_particles[j]->s(sv);
+    m_particles[j]->v(uv);
+
+    force(i, Fi);
+    force(j, Fj);
+    for (unsigned int k = 0; k < 3; ++k) {
+      P[k] = Fj[k]/m_m[j] - Fi[k]/m_m[i];
+    }
+  }
+
+  bool KS_integrator::attracts(const particle& x, const particle& y) {
+    for (particle::const_iterator f = x.begin(); f != x.end(); ++f) {
+      const gravitational_force* g
+        = dynamic_cast<const gravitational_force*>(&*f);
+      if (g && &g->source() == &y) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Boris_integrator::Boris_integrator(system& sys)
+    : simple_integrator(sys), m_fallback(true) { }
+
+  Boris_integrator::~Boris_integrator() { }
+
+  scalar_time Boris_integrator::step(const scalar_time& dt,
+                                     scalar_time& elapsed) {
+    if (!start()) {
+      if (!m_fallback) {
+        apply();
+        m_fallback = true;
+      }
+      return simple_step(dt, elapsed, m_tableau);
+    }
+    m_fallback = false;
+
+    scalar h = convert<scalar>(dt);
+    drift(h/2);
+    evaluate();
+    push(h);
+    drift(h/2);
+
+    finish();
+    sys().collision();
+
+    elapsed += dt;
+    return dt;
+  }
+
+  bool Boris_integrator::start() {
+    std::size_t n = 0;
+    for (system::iterator b = sys().begin(); b != sys().end(); ++b) {
+      if (!dynamic_cast<simple_body*>(&*b)) {
+        return false;
+      }
+      n += b->size();
+    }
+
+    m_particles.resize(n);
+    m_s.resize(3*n, scalar(0));
+    m_v.resize(3*n, scalar(0));
+    m_E.resize(3*n, scalar(0));
+    m_B.resize(3*n, scalar(0));
+    m_F.resize(3*n, scalar(0));
+    m_q.resize(n, scalar(0));
+    m_m.resize(n, scalar(0));
+
+    unsigned int i = 0;
+    for (system::iterator b = sys().begin(); b != sys().end(); ++b) {
+      for (body::iterator x = b->begin(); x != b->end(); ++x, ++i) {
+        m_particles[i] = &*x;
+        const charge* q = dynamic_cast<const charge*>(&*x);
+        m_q[i] = q ? convert<scalar>(q->q()) : scalar(0);
+        m_m[i] = convert<scalar>(x->m());
+        flatten(x->s(), &m_s[3*i]);
+        flatten(x->v(), &m_v[3*i]);
+      }
+    }
+    return true;
+  }
+
+  void Boris_integrator::finish() {
+    vector_displacement s;
+    vector_velocity v;
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      unflatten(s, &m_s[3*i]);
+      unflatten(v, &m_v[3*i]);
+      m_particles[i]->s(s);
+      m_particles[i]->v(v);
+    }
+  }
+
+  void Boris_integrator::drift(const scalar& h) {
+    for (std::size_t i = 0; i < m_s.size(); ++i) {
+      m_s[i].addmul(h, m_v[i]);
+    }
+  }
+
+  void Boris_integrator::evaluate() {
+    // Every particle is moved before any field is read, as the fields of
+    // moving charges depend on where their sources are
+    vector_displacement s;
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      unflatten(s, &m_s[3*i]);
+      m_particles[i]->s(s);
+    }
+
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      particle& x = *m_particles[i];
+      vector_electric_field E = 0;
+      vector_magnetic_field B = 0;
+      vector_force F = 0;
+      for (particle::const_iterator f = x.begin(); f != x.end(); ++f) {
+        const field_source* field = dynamic_cast<const field_source*>(&*f);
+        if (field) {
+          // Fields exert nothing on neutral particles
+          if (sgn(m_q[i]) != 0) {
+            field->field(x, E, B);
+          }
+        } else {
+          F += f->force(x);
+        }
+      }
+      flatten(E, &m_E[3*i]);
+      flatten(B, &m_B[3*i]);
+      flatten(F, &m_F[3*i]);
+    }
+  }
+
+  void Boris_integrator::push(const scalar& h) {
+    scalar c, a[3], t[3], s[3], u[3], w[3], tt;
+    for (unsigned int i = 0; i < m_particles.size(); ++i) {
+      const scalar* E = &m_E[3*i];
+      const scalar* B = &m_B[3*i];
+      const scalar* F = &m_F[3*i];
+      scalar* v = &m_v[3*i];
+
+      // Half a kick: a = (q*E + F)*h/(2*m)
+      c = h/(2*m_m[i]);
+      for (unsigned int k = 0; k < 3; ++k) {
+        a[k] = F[k];
+        a[k].addmul(m_q[i], E[k]);
+        a[k] *= c;
+        u[k] = v[k] + a[k];
+      }
+
+      // Rotation by t = q*B*h/(2*m), with s = 2*t/(1 + t.t) keeping |u|
+      c *= m_q[i];
+      tt = 0;
+      for (unsigned int k = 0; k < 3; ++k) {
+        t[k] = c*B[k];
+        tt.addmul(t[k], t[k]);
+      }
+      tt += 1;
+      for (unsigned int k = 0; k < 3; ++k) {
+        s[k] = 2*t[k]/tt;
+      }
+      for (unsigned int k = 0; k < 3; ++k) {
+        unsigned int k1 = (k + 1)%3, k2 = (k + 2)%3;
+        w[k] = u[k1]*t[k2] - u[k2]*t[k1];
+        w[k] += u[k];
+      }
+      for (unsigned int k = 0; k < 3; ++k) {
+        unsigned int k1 = (k + 1)%3, k2 = (k + 2)%3;
+        u[k] += w[k1]*s[k2] - w[k2]*s[k1];
+      }
+
+      for (unsigned int k = 0; k < 3; ++k) {
+        v[k] = u[k] + a[k];
+      }
+    }
+  }
+
+  symplectic_integrator::symplectic_integrator(system& sys, unsigned int order,
+                                               bool drift_first)
+    : integrator(sys), m_state(sys), m_forces(false),
+      m_drift_first(drift_first), m_order(2) {
+    m_state.gather(m_y);
+    m_dy.resize(m_y.size());
+
+    // The lengths of the second-order substeps. Each triple jump
+    // w1*S(w1*h)*S(w0*h)*S(w1*h), with 2*w1 + w0 = 1 and
+    // 2*w1^(n+1) + w0^(n+1) = 0, raises the order n by two.
+    std::vector<scalar> w(1, scalar(1)), v;
+    for (; m_order < order; m_order += 2) {
+      scalar w1 = 1/(2 - pow(scalar(2), scalar(1)/(m_order + 1)));
+      scalar w0 = 1 - 2*w1;
+
+      v.clear();
+      for (unsigned int i = 0; i < w.size(); ++i) { v.push_back(w1*w[i]); }
+      for (unsigned int i = 0; i < w.size(); ++i) { v.push_back(w0*w[i]); }
+      for (unsigned int i = 0; i < w.size(); ++i) { v.push_back(w1*w[i]); }
+      w.swap(v);
+    }
+
+    // Adjacent half-operations of consecutive substeps merge:
+    // A(w1/2) B(w1) A((w1 + w2)/2) B(w2) ... B(wn) A(wn/2)
+    m_c.push_back(w.front()/2);
+    for (unsigned int i = 0; i < w.size(); ++i) {
+      m_c.push_back(w[i]);
+      if (i + 1 < w.size()) {
+        m_c.push_back((w[i] + w[i + 1])/2);
+      }
+    }
+    m_c.push_back(w.back()/2);
+  }
+
+  symplectic_integrator::~symplectic_integrator() { }
+
+  unsigned int symplectic_integrator::order() const { return m_order; }
+
+  scalar_time symplectic_integrator::step(const scalar_time& dt,
+                                          scalar_time& elapsed) {
+    scalar h = convert<scalar>(dt);
+    for (unsigned int i = 0; i < m_c.size(); ++i) {
+      if ((i%2 == 0) == m_drift_first) {
+        drift(m_c[i]*h);
+      } else {
+        kick(m_c[i]*h);
+      }
+    }
+
+    m_state.scatter(m_y);
+    sys().collision();
+
+    // Collisions only change momenta, so the forces remain valid unless
+    // particles came or went
+    std::size_t n = m_y.size();
+    m_state.gather(m_y);
+    if (m_y.size() != n) {
+      m_dy.resize(m_y.size());
+      m_forces = false;
+    }
+
+    elapsed += dt;
+    return dt;
+  }
+
+  void symplectic_integrator::kick(const scalar& h) {
+    if (!m_forces) {
+      m_state.scatter(m_y);
+      m_state.momentum_derivative(m_y, m_dy);
+      m_forces = true;
+    }
+
+    // The last three of each block of six are momenta
+    for (std::size_t i = 3; i < m_y.size(); i += 6) {
+      m_y[i].addmul(h, m_dy[i]);
+      m_y[i + 1].addmul(h, m_dy[i + 1]);
+      m_y[i + 2].addmul(h, m_dy[i + 2]);
+    }
+  }
+
+  void symplectic_integrator::drift(const scalar& h) {
+    m_state.scatter(m_y);
+    m_state.coordinate_derivative(m_y, m_dy);
+    m_forces = false;
+
+    for (std::size_t i = 0; i < m_y.size(); i += 6) {
+      m_y[i].addmul(h, m_dy[i]);
+      m_y[i + 1].addmul(h, m_dy[i + 1]);
+      m_y[i + 2].addmul(h, m_dy[i + 2]);
+    }
+  }
+
+  velocity_Verlet_integrator::velocity_Verlet_integrator(system& sys)
+    : symplectic_integrator(sys, 2, false) { }
+  velocity_Verlet_integrator::~velocity_Verlet_integrator() { }
+
+  leapfrog_integrator::leapfrog_integrator(system& sys)
+    : symplectic_integrator(sys, 2, true) { }
+  leapfrog_integrator::~leapfrog_integrator() { }
+
+  Forest_Ruth_integrator::Forest_Ruth_integrator(system& sys)
+    : symplectic_integrator(sys, 4, false) { }
+  Forest_Ruth_integrator::~Forest_Ruth_integrator() { }
+
+  Yoshida_integrator::Yoshida_integrator(system& sys, unsigned int order)
+    : symplectic_integrator(sys, order, false) { }
+  Yoshida_integrator::~Yoshida_integrator() { }
+
+  RESPA_integrator::RESPA_integrator(system& sys, unsigned int substeps)
+    : integrator(sys), m_state(sys), m_fast_forces(false),
+      m_slow_forces(false), m_substeps(std::max(substeps, 1U)) {
+    m_state.gather(m_y);
+    m_dy.resize(m_y.size());
+    m_fast.resize(m_y.size());
+    m_slow.resize(m_y.size());
+  }
+
+  RESPA_integrator::~RESPA_integrator() { }
+
+  unsigned int RESPA_integrator::substeps() const { return m_substeps; }
+
+  void RESPA_integrator::substeps(unsigned int substeps) {
+    m_substeps = std::max(substeps, 1U);
+  }
+
+  scalar_time RESPA_integrator::step(const scalar_time& dt,
+                                     scalar_time& elapsed) {
+    scalar h = convert<scalar>(dt), dh = h/m_substeps;
+
+    kick(h/2, applied_force::slow);
+    for (unsigned int i = 0; i < m_substeps; ++i) {
+      kick(dh/2, applied_force::fast);
+      drift(dh);
+      kick(dh/2, applied_force::fast);
+    }
+    kick(h/2, applied_force::slow);
+
+    m_state.scatter(m_y);
+    sys().collision();
+
+    // Collisions only change momenta, so the forces remain valid unless
+    // particles came or went
+    std::size_t n = m_y.size();
+    m_state.gather(m_y);
+    if (m_y.size() != n) {
+      m_dy.resize(m_y.size());
+      m_fast.resize(m_y.size());
+      m_slow.resize(m_y.size());
+      m_fast_forces = false;
+      m_slow_forces = false;
+    }
+
+    elapsed += dt;
+    return dt;
+  }
+
+  void RESPA_integrator::kick(const scalar& h,
+                              applied_force::timescale scale) {
+    bool& valid = scale == applied_force::fast ? m_fast_forces : m_slow_forces;
+    state_vector& dy = scale == applied_force::fast ? m_fast : m_slow;
+    if (!valid) {
+      m_state.scatter(m_y);
+      m_state.momentum_derivative(m_y, dy, scale);
+      valid = true;
+    }
+
+    // The last three of each block of six are momenta
+    for (std::size_t i = 3; i < m_y.size(); i += 6) {
+      m_y[i].addmul(h, dy[i]);
+      m_y[i + 1].addmul(h, dy[i + 1]);
+      m_y[i + 2].addmul(h, dy[i + 2]);
+    }
+  }
+
+  void RESPA_integrator::drift(const scalar& h) {
+    m_state.scatter(m_y);
+    m_state.coordinate_derivative(m_y, m_dy);
+    m_fast_forces = false;
+    m_slow_forces = false;
+
+    for (std::size_t i = 0; i < m_y.size(); i += 6) {
+      m_y[i].addmul(h, m_dy[i]);
+      m_y[i + 1].addmul(h, m_dy[i + 1]);
+      m_y[i + 2].addmul(h, m_dy[i + 2]);
+    }
+  }
+
+  implicit_integrator::implicit_integrator(system& sys, const scalar& theta)
+    : integrator(sys), m_state(sys), m_J(m_state), m_theta(theta),
+      m_tol(sqrt(pow(scalar(2), 1 - scalar(precision())))),
+      m_jacobian(false), m_converged(true), m_working(0) {
+    m_state.gather(m_y0);
+    m_f.resize(m_y0.size());
+    m_state.derivative(m_y0, m_f);
+  }
+
+  implicit_integrator::~implicit_integrator() { }
+
+  scalar implicit_integrator::tol() const { return m_tol; }
+  void implicit_integrator::tol(const scalar& tol) { m_tol = tol; }
+
+  unsigned long implicit_integrator::working_precision() const {
+    return m_working;
+  }
+
+  void implicit_integrator::working_precision(unsigned long bits) {
+    m_working = bits;
+  }
+
+  bool implicit_integrator::converged() const { return m_converged; }
+
+  scalar_time implicit_integrator::step(const scalar_time& dt,
+                                        scalar_time& elapsed) {
+    scalar_time h = dt;
+    m_converged = solve(m_theta*convert<scalar>(h));
+    for (unsigned int n = 0; !m_converged && n < 10; ++n) {
+      // newton() left the bodies at its last iterate
+      h /= 2;
+      m_state.scatter(m_y0);
+      m_converged = solve(m_theta*convert<scalar>(h));
+    }
+
+    // y1 = y0 + (z - y0)/theta
+    for (std::size_t i = 0; i < m_z.size(); ++i) {
+      m_z[i] -= m_y0[i];
+      m_z[i] /= m_theta;
+      m_z[i] += m_y0[i];
+    }
+    m_state.scatter(m_z);
+    sys().collision();
+
+    std::size_t n = m_y0.size();
+    m_state.gather(m_y0);
+    if (m_y0.size() != n) {
+      m_f.resize(m_y0.size());
+      m_jacobian = false;
+    }
+    m_state.derivative(m_y0, m_f);
+
+    elapsed += h;
+    return dt;
+  }
+
+  bool implicit_integrator::solve(const scalar& c) {
+    bool fresh = false;
+
+    unsigned long full = precision(), bits = m_working;
+    bool mixed = bits != 0 && bits < full;
+
+    bool refactor = m_jacobian && c != m_c;
+    m_c = c;
+
+    {
+      scoped_precision p(mixed ? bits : full);
+      // No point iterating past what the working precision can resolve
+      scalar tol = m_tol;
+      if (mixed) {
+        tol = std::max(tol, sqrt(pow(scalar(2), 1 - scalar(bits))));
+      }
+
+      // evaluate() leaves its argument rounded to the current precision, so
+      // it gets a copy of y0 when that isn't the full one
+      state_vector& y0 = mixed ? m_yw : m_y0;
+      if (mixed) {
+        m_yw = m_y0;
+      }
+
+      // The bodies are in the state y0 here
+      if (!m_jacobian) {
+        m_J.evaluate(y0, m_f);
+        m_J.factor(c);
+        m_jacobian = true;
+        fresh = true;
+      } else if (refactor) {
+        m_J.factor(c);
+      }
+
+      if (!newton(c, tol, true)) {
+        if (fresh) {
+          return false;
+        }
+
+        // The old Jacobian is too far off; start again with a new one
+        m_state.scatter(y0);
+        m_J.evaluate(y0, m_f);
+        m_J.factor(c);
+        fresh = true;
+        if (!newton(c, tol, true)) {
+          return false;
+        }
+      }
+    }
+
+    // Iterative refinement: the same iteration, with the residual at full
+    // precision and the low-precision factors for the corrections. If that
+    // doesn't converge, the factors are too far off to refine with.
+    if (mixed && !newton(c, m_tol, false)) {
+      m_jacobian = false;
+      return false;
+    }
+
+    return true;
+  }
+
+  bool implicit_integrator::newton(const scalar& c, const scalar& tol,
+                                   bool predict) {
+    // Start from the explicit Euler predictor
+    m_z.resize(m_y0.size());
+    m_dz.resize(m_y0.size());
+    for (std::size_t i = 0; predict && i < m_z.size(); ++i) {
+      m_z[i] = m_y0[i];
+      m_z[i].addmul(c, m_f[i]);
+    }
+
+    for (unsigned int n = 0; n < 8; ++n) {
+      // Solve (I - c*J)dz = y0 + c*f(z) - z
+      m_state.scatter(m_z);
+      m_state.derivative(m_z, m_dz);
+      for (std::size_t i = 0; i < m_dz.size(); ++i) {
+        m_dz[i] *= c;
+        m_dz[i] += m_y0[i];
+        m_dz[i] -= m_z[i];
+      }
+      m_J.solve(m_dz);
+
+      bool converged = true;
+      for (std::size_t i = 0; i < m_z.size(); ++i) {
+        m_z[i] += m_dz[i];
+        if (abs(m_dz[i]) > tol*std::max(abs(m_z[i]), scalar(1))) {
+          converged = false;
+        }
+      }
+      if (converged) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  backward_Euler_integrator::backward_Euler_integrator(system& sys)
+    : implicit_integrator(sys, 1) { }
+  backward_Euler_integrator::~backward_Euler_integrator() { }
+
+  implicit_midpoint_integrator::implicit_midpoint_integrator(system& sys)
+    : implicit_integrator(sys, scalar(1)/2) { }
+  implicit_midpoint_integrator::~implicit_midpoint_integrator() { }
+
+  ROS2_integrator::ROS2_integrator(system& sys, const scalar& tol)
+    : adaptive_integrator(sys, tol, 1), m_state(sys), m_J(m_state),
+      m_gamma(1 + 1/sqrt(scalar(2))), m_stiffness(0) {
+    restart();
+  }
+
+  ROS2_integrator::~ROS2_integrator() { }
+
+  scalar_time ROS2_integrator::step(const scalar_time& dt,
+                                    scalar_time& elapsed) {
+    scalar_time delta, deltaprime = dt;
+    scalar h, err, e, df, k;
+    bool fresh = false;
+
+    if (!m_jacobian) {
+      m_J.evaluate(m_y0, m_f);
+      m_jacobian = true;
+      fresh = true;
+    }
+
+    m_k1.resize(m_y0.size());
+    m_k2.resize(m_y0.size());
+    m_y.resize(m_y0.size());
+
+    bool rejected = true;
+
+    while (rejected) {
+      delta = deltaprime;
+      h = convert<scalar>(delta);
+      m_J.factor(m_gamma*h);
+
+      // (I - gamma*h*J)k1 = f(y0)
+      // (I - gamma*h*J)k2 = f(y0 + h*k1) - 2*k1
+      for (std::size_t i = 0; i < m_k1.size(); ++i) {
+        m_k1[i] = m_f[i];
+      }
+      m_J.solve(m_k1);
+
+      for (std::size_t i = 0; i < m_y.size(); ++i) {
+        m_y[i] = m_y0[i];
+        m_y[i].addmul(h, m_k1[i]);
+      }
+      m_state.scatter(m_y);
+      m_state.derivative(m_y, m_k2);
+
+      df = 0;
+      k = 0;
+      for (std::size_t i = 0; i < m_k2.size(); ++i) {
+        df = std::max(df, abs(m_k2[i] - m_f[i]));
+        k = std::max(k, abs(m_k1[i]));
+      }
+      m_stiffness = sgn(k) == 0 ? scalar(0) : df/k;
+
+      for (std::size_t i = 0; i < m_k2.size(); ++i) {
+        m_k2[i] -= m_k1[i];
+        m_k2[i] -= m_k1[i];
+      }
+      m_J.solve(m_k2);
+
+      // The first-order solution is y0 + h*k1, so the error is h*(k1 + k2)/2
+      e = h/2;
+      for (std::size_t i = 0; i < m_y.size(); ++i) {
+        m_y[i] = m_k1[i];
+        m_y[i] += m_k2[i];
+        m_y[i] *= e;
+      }
+      norm().clear();
+      m_state.error(m_y0, m_y, norm());
+      err = norm().value();
+
+      rejected = !accept(err, deltaprime);
+      if (rejected && !fresh) {
+        m_state.scatter(m_y0);
+        m_J.evaluate(m_y0, m_f);
+        fresh = true;
+      }
+    }
+
+    // y1 = y0 + 3/2*h*k1 + 1/2*h*k2
+    scalar b1 = 3*h/2, b2 = h/2;
+    for (std::size_t i = 0; i < m_y.size(); ++i) {
+      m_y[i] = m_y0[i];
+      m_y[i].addmul(b1, m_k1[i]);
+      m_y[i].addmul(b2, m_k2[i]);
+    }
+    m_state.scatter(m_y);
+    sys().collision();
+
+    std::size_t n = m_y0.size();
+    m_state.gather(m_y0);
+    m_f.resize(m_y0.size());
+    m_state.derivative(m_y0, m_f);
+    if (m_y0.size() != n) {
+      m_jacobian = false;
+    }
+
+    elapsed += delta;
+    return deltaprime;
+  }
+
+  void ROS2_integrator::restart() {
+    m_state.gather(m_y0);
+    m_f.resize(m_y0.size());
+    m_state.derivative(m_y0, m_f);
+    m_jacobian = false;
+  }
+
+  const scalar& ROS2_integrator::stiffness() const { return m_stiffness; }
+
+  stiffness_switching_integrator::stiffness_switching_integrator(
+    system& sys, const scalar& tol
+  ) : ROS2_integrator(sys, tol), m_stiff(false), m_count(0) {
+    engine(new flat_engine(sys));
+  }
+
+  stiffness_switching_integrator::~stiffness_switching_integrator() { }
+
+  bool stiffness_switching_integrator::stiff() const { return m_stiff; }
+
+  scalar_time stiffness_switching_integrator::step(const scalar_time& dt,
+                                                   scalar_time& elapsed) {
+    scalar_time deltaprime;
+
+    if (m_stiff) {
+      deltaprime = ROS2_integrator::step(dt, elapsed);
+      if (stiffness() < scalar("3.25")) {
+        ++m_count;
+      } else {
+        m_count = 0;
+      }
+    } else {
+      // accepted() does the counting
+      deltaprime = adaptive_step(dt, elapsed, m_tableau);
+    }
+
+    if (m_count >= 15) {
+      m_stiff = !m_stiff;
+      m_count = 0;
+
+      // The other method's state is out of date, and its errors aren't
+      // comparable
+      if (m_stiff) {
+        restart();
+      } else {
+        apply();
+      }
+      controller()->reset();
+    }
+
+    return deltaprime;
+  }
+
+  void stiffness_switching_integrator::accepted(const tableau& t) {
+    const flat_engine* e = dynamic_cast<const flat_engine*>(engine());
+    if (!e) {
+      m_count = 0;
+      return;
+    }
+
+    // For a linear system, f(Y[i]) = P[i](hJ)*f(y0), where P[0] = 1 and
+    // P[i] = 1 + x*sum(a[i-1][j]*P[j]). P[i] has degree i, so the stages give
+    // v[k] = (hJ)^k*f(y0) for k < n, and |v[n-1]|/|v[n-3]| is (h*lambda)^2
+    // for the dominant eigenvalue, whatever the phase of an oscillation.
+    unsigned int n = t.stages();
+    std::vector<b_vector> P(n, b_vector(n, scalar(0)));
+    P[0][0] = 1;
+    for (unsigned int i = 1; i < n; ++i) {
+      P[i][0] = 1;
+      for (unsigned int j = 0; j < i; ++j) {
+        for (unsigned int k = 0; k < i; ++k) {
+          P[i][k + 1].addmul(t.a()[i - 1][j], P[j][k]);
+        }
+      }
+      if (sgn(P[i][i]) == 0) {
+        m_count = 0;
+        return;
+      }
+    }
+
+    b_vector v(n);
+    scalar hi = 0, lo = 0;
+    for (std::size_t i = 0; i < e->state().size(); ++i) {
+      const scalar& f0 = e->derivative(0)[i];
+      for (unsigned int k = 1; k < n; ++k) {
+        v[k] = e->derivative(k)[i] - f0;
+        for (unsigned int j = 1; j < k; ++j) {
+          v[k] -= P[k][j]*v[j];
+        }
+        v[k] /= P[k][k];
+      }
+      hi = std::max(hi, abs(v[n - 1]));
+      lo = std::max(lo, abs(v[n - 3]));
+    }
+
+    // h*lambda > 3.25
+    if (sgn(lo) != 0 && hi/lo > scalar("10.5625")) {
+      ++m_count;
+    } else {
+      m_count = 0;
+    }
   }
 }
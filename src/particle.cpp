@@ -37,6 +37,12 @@ namespace carom
   void particle::a(const vector_acceleration& a) { m_force = m_mass*a; }
   void particle::F(const vector_force& F)        { m_force = F; }
 
+  void particle::assign(const particle& x) {
+    m_mass     = x.m_mass;
+    m_position = x.m_position;
+    m_momentum = x.m_momentum;
+  }
+
   particle::iterator particle::apply_force(applied_force* force) {
     return m_forces.insert(m_forces.end(), force);
   }
@@ -57,4 +63,32 @@ namespace carom
       m_force += i->force(*this);
     }
   }
+
+  void particle::apply_forces(applied_force::timescale scale) {
+    m_force = 0;
+
+    for (iterator i = m_forces.begin(); i != m_forces.end(); ++i) {
+      if (i->scale() == scale) {
+        m_force += i->force(*this);
+      }
+    }
+  }
+
+  bool particle::jacobian(scalar* J) const {
+    for (const_iterator i = m_forces.begin(); i != m_forces.end(); ++i) {
+      if (!i->jacobian(*this, J)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool particle::jerk(scalar* dF) const {
+    for (const_iterator i = m_forces.begin(); i != m_forces.end(); ++i) {
+      if (!i->jerk(*this, dF)) {
+        return false;
+      }
+    }
+    return true;
+  }
 }
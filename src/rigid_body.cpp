@@ -18,6 +18,7 @@
  *************************************************************************/
 
 #include <carom.hpp>
+#include <boost/bind/bind.hpp>
 #include <algorithm> // For max()
 #include <vector>
 
@@ -69,15 +70,65 @@ namespace carom
     return new rigid_k_base(dt()/n, dp()/n, dL()/n);
   }
 
+  void rigid_k_base::axpy(const std::vector<scalar>& a,
+                          const std::vector<k_value>& k) {
+    // A body's k-values all come from its own f(), so the cast is safe
+    const rigid_k_base& k0 = static_cast<const rigid_k_base&>(*k[0].base());
+
+    m_dt = k0.m_dt;
+    m_dp = k0.m_dp;
+    m_dL = k0.m_dL;
+    m_dt *= a[0];
+    m_dp *= a[0];
+    m_dL *= a[0];
+
+    for (unsigned int j = 1; j < a.size(); ++j) {
+      if (sgn(a[j]) != 0) {
+        const rigid_k_base& kj = static_cast<const rigid_k_base&>(*k[j].base());
+        m_dt.addmul(a[j], kj.m_dt);
+        m_dp.addmul(a[j], kj.m_dp);
+        m_dL.addmul(a[j], kj.m_dL);
+      }
+    }
+  }
+
+  k_base* rigid_k_base::clone() const {
+    return new rigid_k_base(*this);
+  }
+
+  void rigid_k_base::error(const body& y0, const scalar_time& dt,
+                           error_norm& norm) const {
+    // As in simple_k_base, errors in dp and dL lead to errors of dt*dp/(2*m)
+    // and dt*dL/(2*I) in the position and orientation
+    const rigid_body& backup = static_cast<const rigid_body&>(y0);
+    vector_displacement o = backup.center_of_mass();
+
+    scalar dp = convert<scalar>(carom::norm(m_dp));
+    norm.add(error_norm::momentum, dp,
+             convert<scalar>(carom::norm(backup.momentum())));
+    norm.add(error_norm::position,
+             convert<scalar>(abs(dt)/(2*backup.mass()))*dp,
+             convert<scalar>(carom::norm(o)));
+
+    scalar dL = convert<scalar>(carom::norm(m_dL));
+    norm.add(error_norm::angular_momentum, dL,
+             convert<scalar>(carom::norm(backup.angular_momentum(o))));
+    if (sgn(dL) == 0) {
+      norm.add(error_norm::angle, 0, 0);
+    } else {
+      scalar_moment_of_inertia I =
+        backup.moment_of_inertia(o, normalized(m_dL));
+      norm.add(error_norm::angle, convert<scalar>(abs(dt)/(2*I))*dL, 0);
+    }
+  }
+
   scalar_moment_of_inertia
   rigid_body::moment_of_inertia(const vector_displacement& o,
                                 const vector& axis) const {
-    scalar_moment_of_inertia I = 0;
-    for (const_iterator i = begin(); i != end(); ++i) {
-      scalar_distance r = norm(i->s() - o - proj(axis, i->s() - o));
-      I += i->m()*r*r;
-    }
-    return I;
+    return sum<scalar_moment_of_inertia>(
+      boost::bind(&rigid_body::moment_of_inertia_of, boost::placeholders::_1,
+                  boost::cref(o), boost::cref(axis))
+    );
   }
 
   vector_angular_velocity
@@ -88,11 +139,10 @@ namespace carom
 
   vector_angular_momentum
   rigid_body::angular_momentum(const vector_displacement& o) const {
-    vector_angular_momentum L = 0;
-    for (const_iterator i = begin(); i != end(); ++i) {
-      L += cross(i->s() - o, i->p());
-    }
-    return L;
+    return sum<vector_angular_momentum>(
+      boost::bind(&rigid_body::angular_momentum_of, boost::placeholders::_1,
+                  boost::cref(o))
+    );
   }
 
   vector_angular_acceleration
@@ -102,11 +152,29 @@ namespace carom
   }
 
   vector_torque rigid_body::torque(const vector_displacement& o) const {
-    vector_torque T = 0;
-    for (const_iterator i = begin(); i != end(); ++i) {
-      T += cross(i->s() - o, i->F());
-    }
-    return T;
+    return sum<vector_torque>(
+      boost::bind(&rigid_body::torque_of, boost::placeholders::_1,
+                  boost::cref(o))
+    );
+  }
+
+  scalar_moment_of_inertia
+  rigid_body::moment_of_inertia_of(const particle& x,
+                                   const vector_displacement& o,
+                                   const vector& axis) {
+    scalar_distance r = norm(x.s() - o - proj(axis, x.s() - o));
+    return x.m()*r*r;
+  }
+
+  vector_angular_momentum
+  rigid_body::angular_momentum_of(const particle& x,
+                                  const vector_displacement& o) {
+    return cross(x.s() - o, x.p());
+  }
+
+  vector_torque rigid_body::torque_of(const particle& x,
+                                      const vector_displacement& o) {
+    return cross(x.s() - o, x.F());
   }
 
   scalar_mass rigid_body::mass(const particle& x) const {
@@ -145,10 +213,7 @@ namespace carom
 
     r->backup(new rigid_body());
     for (iterator i = begin(); i != end(); ++i) {
-      iterator j = r->backup()->insert(new particle());
-      j->m(i->m());
-      j->s(i->s());
-      j->p(i->p());
+      r->backup()->insert(new particle())->assign(*i);
     }
 
     return y_value(r);
@@ -175,10 +240,19 @@ namespace carom
   }
 
   void rigid_body::step(const y_value& y0, const k_value& kv) {
-    const rigid_k_base& kval = dynamic_cast<const rigid_k_base&>(*kv.base());
-    const rigid_body& backup =
-      dynamic_cast<const rigid_body&>(*y0.base()->backup());
+    step(dynamic_cast<const rigid_body&>(*y0.base()->backup()),
+         dynamic_cast<const rigid_k_base&>(*kv.base()));
+  }
 
+  void rigid_body::k(const scalar_time& dt, rigid_k_base& k) {
+    apply_forces();
+
+    k.dt(dt);
+    k.dp(dt*force());
+    k.dL(dt*torque(center_of_mass()));
+  }
+
+  void rigid_body::step(const rigid_body& backup, const rigid_k_base& kval) {
     scalar_mass m = backup.mass();
     vector_displacement o = backup.center_of_mass();
     vector_momentum p = backup.momentum();
@@ -205,6 +279,101 @@ namespace carom
       }
     }
   }
+
+  std::size_t rigid_body::dimension() const { return 12; }
+
+  void rigid_body::flatten(const y_value& y0, scalar* y) const {
+    // The center of mass, momentum, rotation since y0, and angular momentum.
+    // We must be in the state y0, so the rotation is zero.
+    vector_displacement o = center_of_mass();
+    carom::flatten(o, y);
+    carom::flatten(momentum(), y + 3);
+    carom::flatten(vector(0), y + 6);
+    carom::flatten(angular_momentum(o), y + 9);
+  }
+
+  void rigid_body::unflatten(const y_value& y0, const scalar* y) {
+    const rigid_body& backup =
+      dynamic_cast<const rigid_body&>(*y0.base()->backup());
+
+    vector_displacement o;
+    vector_momentum p;
+    vector_angle theta;
+    vector_angular_momentum L;
+    carom::unflatten(o, y);
+    carom::unflatten(p, y + 3);
+    carom::unflatten(theta, y + 6);
+    carom::unflatten(L, y + 9);
+
+    scalar_mass m = backup.mass();
+    vector_displacement o0 = backup.center_of_mass();
+
+    iterator i = begin();
+    const_iterator j = backup.begin();
+    for (; i != end(); ++i, ++j) {
+      i->s(rotate(j->s(), o0, theta) - o0 + o);
+    }
+
+    if (L == 0) {
+      for (i = begin(); i != end(); ++i) {
+        i->v(p/m);
+      }
+    } else {
+      scalar_moment_of_inertia I = moment_of_inertia(o, normalized(L));
+
+      for (i = begin(); i != end(); ++i) {
+        i->v(p/m + cross(L/I, i->s() - o));
+      }
+    }
+  }
+
+  void rigid_body::coordinate_derivative(const scalar* y, scalar* dy) {
+    // As in step(), the rate of rotation is taken to be L/I, with I measured
+    // around L
+    vector_momentum p;
+    vector_angular_momentum L;
+    carom::unflatten(p, y + 3);
+    carom::unflatten(L, y + 9);
+
+    carom::flatten(p/mass(), dy);
+    if (L == 0) {
+      carom::flatten(vector_angular_velocity(0), dy + 6);
+    } else {
+      vector_displacement o = center_of_mass();
+      carom::flatten(L/moment_of_inertia(o, normalized(L)), dy + 6);
+    }
+  }
+
+  void rigid_body::error(const scalar* y, const scalar* e,
+                         error_norm& norm) const {
+    vector_displacement o, dO;
+    vector_momentum p, dp;
+    vector_angle theta, dtheta;
+    vector_angular_momentum L, dL;
+    carom::unflatten(o,      y);
+    carom::unflatten(dO,     e);
+    carom::unflatten(p,      y + 3);
+    carom::unflatten(dp,     e + 3);
+    carom::unflatten(theta,  y + 6);
+    carom::unflatten(dtheta, e + 6);
+    carom::unflatten(L,      y + 9);
+    carom::unflatten(dL,     e + 9);
+
+    norm.add(error_norm::position, convert<scalar>(carom::norm(dO)),
+             convert<scalar>(carom::norm(o)));
+    norm.add(error_norm::momentum, convert<scalar>(carom::norm(dp)),
+             convert<scalar>(carom::norm(p)));
+    norm.add(error_norm::angle, convert<scalar>(carom::norm(dtheta)),
+             convert<scalar>(carom::norm(theta)));
+    norm.add(error_norm::angular_momentum, convert<scalar>(carom::norm(dL)),
+             convert<scalar>(carom::norm(L)));
+  }
+
+  void rigid_body::force_derivative(const scalar* y, scalar* dy) {
+    vector_displacement o = center_of_mass();
+    carom::flatten(force(), dy + 3);
+    carom::flatten(torque(o), dy + 9);
+  }
  
   template <>
   scalar_mass impenetrable_body<rigid_body>::mass(const triangle& t) {
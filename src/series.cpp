@@ -0,0 +1,116 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+#include <vector>
+
+namespace carom
+{
+  series::series() { }
+
+  scalar& series::operator[](unsigned int k) {
+    if (k >= m_coeffs.size()) {
+      m_coeffs.resize(k + 1, scalar(0));
+    }
+    return m_coeffs[k];
+  }
+
+  const scalar& series::operator[](unsigned int k) const {
+    return m_coeffs[k];
+  }
+
+  std::size_t series::size() const { return m_coeffs.size(); }
+  void series::resize(std::size_t n) { m_coeffs.resize(n, scalar(0)); }
+
+  scalar series::operator()(const scalar& h) const {
+    scalar x = 0;
+    for (std::size_t k = m_coeffs.size(); k-- > 0;) {
+      x *= h;
+      x += m_coeffs[k];
+    }
+    return x;
+  }
+
+  void add(series& r, const series& a, const series& b, unsigned int k) {
+    r[k] = a[k];
+    r[k] += b[k];
+  }
+
+  void subtract(series& r, const series& a, const series& b, unsigned int k) {
+    r[k] = a[k];
+    r[k] -= b[k];
+  }
+
+  void multiply(series& r, const series& a, const series& b, unsigned int k) {
+    // The Cauchy product, r[k] = sum(a[j]*b[k - j])
+    scalar& rk = r[k];
+    rk = 0;
+    for (unsigned int j = 0; j <= k; ++j) {
+      rk.addmul(a[j], b[k - j]);
+    }
+  }
+
+  void divide(series& r, const series& a, const series& b, unsigned int k) {
+    // a = r*b, so r[k] = (a[k] - sum(b[j]*r[k - j], j = 1..k))/b[0]
+    scalar& rk = r[k];
+    rk = a[k];
+    for (unsigned int j = 1; j <= k; ++j) {
+      rk -= b[j]*r[k - j];
+    }
+    rk /= b[0];
+  }
+
+  void pow(series& r, const series& a, const scalar& e, unsigned int k) {
+    // a*r' = e*a'*r gives
+    // r[k] = sum((e*(k - j) - j)*a[k - j]*r[j], j = 0..k-1)/(k*a[0])
+    scalar& rk = r[k];
+    if (k == 0) {
+      rk = pow(a[0], e);
+      return;
+    }
+
+    rk = 0;
+    for (unsigned int j = 0; j < k; ++j) {
+      rk.addmul((e*(k - j) - j)*a[k - j], r[j]);
+    }
+    rk /= k*a[0];
+  }
+
+  void dot(series& r, const series* a, const series* b, unsigned int k) {
+    scalar& rk = r[k];
+    rk = 0;
+    for (unsigned int i = 0; i < 3; ++i) {
+      for (unsigned int j = 0; j <= k; ++j) {
+        rk.addmul(a[i][j], b[i][k - j]);
+      }
+    }
+  }
+
+  void cross(series* r, const series* a, const series* b, unsigned int k) {
+    for (unsigned int i = 0; i < 3; ++i) {
+      unsigned int i1 = (i + 1)%3, i2 = (i + 2)%3;
+      scalar& rk = r[i][k];
+      rk = 0;
+      for (unsigned int j = 0; j <= k; ++j) {
+        rk.addmul(a[i1][j], b[i2][k - j]);
+        rk -= a[i2][j]*b[i1][k - j];
+      }
+    }
+  }
+}
@@ -18,6 +18,7 @@
  *************************************************************************/
 
 #include <carom.hpp>
+#include <boost/bind/bind.hpp>
 #include <algorithm> // For max()
 #include <vector>
 
@@ -110,6 +111,51 @@ namespace carom
     return r;
   }
 
+  void simple_k_base::axpy(const std::vector<scalar>& a,
+                           const std::vector<k_value>& k) {
+    // A body's k-values all come from its own f(), so the cast is safe, and a
+    // dynamic_cast per term would be wasted
+    const simple_k_base& k0 = static_cast<const simple_k_base&>(*k[0].base());
+
+    resize(k0.size()); // Usually a no-op
+    m_dt = k0.dt();
+    m_dt *= a[0];
+    for (unsigned int i = 0; i < size(); ++i) {
+      m_momenta[i] = k0[i];
+      m_momenta[i] *= a[0];
+    }
+
+    for (unsigned int j = 1; j < a.size(); ++j) {
+      if (sgn(a[j]) != 0) {
+        const simple_k_base& kj =
+          static_cast<const simple_k_base&>(*k[j].base());
+
+        m_dt.addmul(a[j], kj.dt());
+        for (unsigned int i = 0; i < size(); ++i) {
+          m_momenta[i].addmul(a[j], kj[i]);
+        }
+      }
+    }
+  }
+
+  k_base* simple_k_base::clone() const {
+    return new simple_k_base(*this);
+  }
+
+  void simple_k_base::error(const body& y0, const scalar_time& dt,
+                            error_norm& norm) const {
+    // step() moves each particle by dt*(p + dp/2)/m, so an error of dp in
+    // the momentum is an error of dt*dp/(2*m) in the position
+    scalar dp;
+    body::const_iterator j = y0.begin();
+    for (unsigned int i = 0; i < size(); ++i, ++j) {
+      dp = convert<scalar>(carom::norm((*this)[i]));
+      norm.add(error_norm::momentum, dp, convert<scalar>(carom::norm(j->p())));
+      norm.add(error_norm::position, convert<scalar>(abs(dt)/(2*j->m()))*dp,
+               convert<scalar>(carom::norm(j->s())));
+    }
+  }
+
   scalar_mass simple_body::mass(const particle& x) const {
     return x.m();
   }
@@ -122,10 +168,7 @@ namespace carom
     simple_f_base* r = new simple_f_base(size());
 
     apply_forces();
-    iterator j = begin();
-    for (unsigned int i = 0; i < size(); ++i, ++j) {
-      (*r)[i] = j->F();
-    }
+    each(boost::bind(&simple_body::f_at, this, r, boost::placeholders::_1));
 
     return f_value(r);
   }
@@ -135,23 +178,102 @@ namespace carom
 
     r->backup(new simple_body());
     for (iterator i = begin(); i != end(); ++i) {
-      iterator j = r->backup()->insert(new particle());
-      j->m(i->m());
-      j->s(i->s());
-      j->p(i->p());
+      r->backup()->insert(new particle())->assign(*i);
     }
 
     return y_value(r);
   }
 
   void simple_body::step(const y_value& y0, const k_value& kv) {
-    const simple_k_base& kval = dynamic_cast<const simple_k_base&>(*kv.base());
+    step(*y0.base()->backup(), dynamic_cast<const simple_k_base&>(*kv.base()));
+  }
+
+  void simple_body::k(const scalar_time& dt, simple_k_base& k) {
+    apply_forces();
+
+    k.resize(size()); // Usually a no-op
+    k.dt(dt);
+    each(boost::bind(&simple_body::k_at, this, &k, boost::placeholders::_1));
+  }
+
+  void simple_body::step(const body& y0, const simple_k_base& kval) {
+    each(boost::bind(&simple_body::step_at, this, &y0, &kval,
+                     boost::placeholders::_1));
+  }
+
+  std::size_t simple_body::dimension() const { return 6*size(); }
+
+  void simple_body::flatten(const y_value& y0, scalar* y) const {
+    // The position and momentum of each particle
+    for (const_iterator i = begin(); i != end(); ++i, y += 6) {
+      carom::flatten(i->s(), y);
+      carom::flatten(i->p(), y + 3);
+    }
+  }
+
+  void simple_body::unflatten(const y_value& y0, const scalar* y) {
+    vector_displacement s;
+    vector_momentum p;
+    for (iterator i = begin(); i != end(); ++i, y += 6) {
+      carom::unflatten(s, y);
+      carom::unflatten(p, y + 3);
+      i->s(s);
+      i->p(p);
+    }
+  }
+
+  void simple_body::coordinate_derivative(const scalar* y, scalar* dy) {
+    each(boost::bind(&simple_body::velocity_at, this, dy,
+                     boost::placeholders::_1));
+  }
+
+  void simple_body::force_derivative(const scalar* y, scalar* dy) {
+    each(boost::bind(&simple_body::force_at, this, dy,
+                     boost::placeholders::_1));
+  }
 
-    iterator i = begin();
-    const_iterator j = y0.base()->backup()->begin();
-    for (unsigned int k = 0; k < kval.size(); ++i, ++j, ++k) {
-      i->s(j->s() + kval.dt()*(j->p() + kval[k]/2)/j->m());
-      i->p(j->p() + kval[k]);
+  bool simple_body::jacobian(const scalar* y, scalar* J, std::size_t stride) {
+    // ds/dt = p/m, and dp/dt = F(s) as far as the forces can tell us
+    scalar dF[9];
+    for (const_iterator i = begin(); i != end(); ++i, J += 6*stride + 6) {
+      for (unsigned int j = 0; j < 9; ++j) {
+        dF[j] = 0;
+      }
+      if (!i->jacobian(dF)) {
+        return false;
+      }
+
+      scalar m_inv = convert<scalar>(1/i->m());
+      for (unsigned int j = 0; j < 3; ++j) {
+        J[j*stride + 3 + j] += m_inv;
+        for (unsigned int k = 0; k < 3; ++k) {
+          J[(3 + j)*stride + k] += dF[3*j + k];
+        }
+      }
     }
+    return true;
+  }
+
+  void simple_body::f_at(simple_f_base* r, std::size_t i) const {
+    (*r)[i] = (*this)[i].F();
+  }
+
+  void simple_body::k_at(simple_k_base* k, std::size_t i) const {
+    (*k)[i] = k->dt()*(*this)[i].F();
+  }
+
+  void simple_body::step_at(const body* y0, const simple_k_base* k,
+                            std::size_t i) {
+    const particle& x0 = (*y0)[i];
+    (*this)[i].s(x0.s() + k->dt()*(x0.p() + (*k)[i]/2)/x0.m());
+    (*this)[i].p(x0.p() + (*k)[i]);
+  }
+
+  void simple_body::velocity_at(scalar* dy, std::size_t i) const {
+    carom::flatten((*this)[i].v(), dy + 6*i);
+  }
+
+  void simple_body::force_at(scalar* dy, std::size_t i) const {
+    carom::flatten((*this)[i].F(), dy + 6*i + 3);
   }
 }
@@ -0,0 +1,108 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+#include <algorithm> // For min(), max()
+
+namespace carom
+{
+  step_controller::step_controller()
+    : m_safety("0.9"), m_min(scalar(1)/5), m_max(5), m_accepted(0),
+      m_rejected(0) { }
+
+  step_controller::~step_controller() { }
+
+  bool step_controller::control(const scalar& err, unsigned int order,
+                                scalar_time& dt) {
+    scalar k = order + 1;
+
+    if (err <= 1) {
+      ++m_accepted;
+      if (sgn(err) == 0) {
+        dt *= m_max;
+      } else {
+        dt *= std::min(std::max(m_safety*factor(err, k), m_min), m_max);
+      }
+      remember(err);
+      return true;
+    } else {
+      // Past errors say little about a failed step; scale from this one alone
+      ++m_rejected;
+      dt *= std::min(std::max(m_safety*pow(err, -1/k), m_min), scalar(1));
+      return false;
+    }
+  }
+
+  scalar step_controller::safety() const { return m_safety; }
+  void step_controller::safety(const scalar& safety) { m_safety = safety; }
+
+  scalar step_controller::min_factor() const { return m_min; }
+  void step_controller::min_factor(const scalar& min) { m_min = min; }
+
+  scalar step_controller::max_factor() const { return m_max; }
+  void step_controller::max_factor(const scalar& max) { m_max = max; }
+
+  unsigned long step_controller::accepted() const { return m_accepted; }
+  unsigned long step_controller::rejected() const { return m_rejected; }
+
+  void step_controller::reset() { }
+  void step_controller::remember(const scalar& err) { }
+
+  PID_controller::PID_controller()
+    : m_kI("0.3"), m_kP("0.4"), m_kD("0.1"), m_err1(1), m_err2(1) { }
+
+  PID_controller::PID_controller(const scalar& kI, const scalar& kP,
+                                 const scalar& kD)
+    : m_kI(kI), m_kP(kP), m_kD(kD), m_err1(1), m_err2(1) { }
+
+  PID_controller::~PID_controller() { }
+
+  void PID_controller::reset() {
+    // As if the last steps were exactly on tolerance
+    m_err1 = 1;
+    m_err2 = 1;
+  }
+
+  scalar PID_controller::factor(const scalar& err, const scalar& k) const {
+    scalar r = pow(err, -(m_kI + m_kP + m_kD)/k);
+    if (sgn(m_kP) != 0 || sgn(m_kD) != 0) {
+      r *= pow(m_err1, (m_kP + 2*m_kD)/k);
+    }
+    if (sgn(m_kD) != 0) {
+      r *= pow(m_err2, -m_kD/k);
+    }
+    return r;
+  }
+
+  void PID_controller::remember(const scalar& err) {
+    // Exact zeros would wipe out the other terms for good
+    m_err2 = m_err1;
+    m_err1 = sgn(err) == 0 ? m_err2 : err;
+  }
+
+  PI_controller::PI_controller() : PID_controller("0.3", "0.4", 0) { }
+
+  PI_controller::PI_controller(const scalar& kI, const scalar& kP)
+    : PID_controller(kI, kP, 0) { }
+
+  PI_controller::~PI_controller() { }
+
+  I_controller::I_controller() : PID_controller(1, 0, 0) { }
+  I_controller::~I_controller() { }
+}
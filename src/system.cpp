@@ -45,10 +45,8 @@ namespace carom
 
   scalar_energy system::kinetic_energy() const {
     scalar_energy E_k = 0;
-    for (system::const_iterator i = begin(); i != end(); ++i) {
-      for (body::const_iterator j = i->begin(); j != i->end(); ++j) {
-        E_k += j->m()*norm(j->v())*norm(j->v())/2;
-      }
+    for (const_iterator i = begin(); i != end(); ++i) {
+      E_k += i->kinetic_energy();
     }
     return E_k;
   }
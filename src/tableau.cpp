@@ -0,0 +1,241 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+#include <vector>
+
+namespace carom
+{
+  tableau::tableau() : m_order(0) { }
+  tableau::~tableau() { }
+
+  const tableau::a_vector& tableau::a()     const { return m_a; }
+  const tableau::b_vector& tableau::b()     const { return m_b; }
+  const tableau::b_vector& tableau::bstar() const { return m_bstar; }
+
+  std::size_t tableau::stages() const { return m_b.size(); }
+  bool tableau::embedded() const { return !m_bstar.empty(); }
+  unsigned int tableau::order() const { return m_order; }
+
+  bool tableau::dense() const { return !m_dense.empty(); }
+
+  void tableau::dense(const scalar& theta, b_vector& b) const {
+    b.resize(m_dense.size());
+    for (unsigned int i = 0; i < m_dense.size(); ++i) {
+      // Horner's rule
+      b[i] = 0;
+      for (unsigned int j = m_dense[i].size(); j-- > 0;) {
+        b[i] *= theta;
+        b[i] += m_dense[i][j];
+      }
+      b[i] *= theta;
+    }
+  }
+
+  void tableau::order(unsigned int order) { m_order = order; }
+
+  void tableau::row(const scalar* a, std::size_t n) {
+    m_a.push_back(std::vector<scalar>(a, a + n));
+  }
+
+  void tableau::b(const scalar* b, std::size_t n) {
+    m_b.assign(b, b + n);
+  }
+
+  void tableau::bstar(const scalar* bstar, std::size_t n) {
+    m_bstar.assign(bstar, bstar + n);
+  }
+
+  void tableau::dense(const scalar* d, std::size_t n) {
+    m_dense.push_back(std::vector<scalar>(d, d + n));
+  }
+
+  Euler_tableau::Euler_tableau() {
+    // Euler method. Simplest Runge-Kutta method. First order. Its tableau is:
+    //
+    //   0|
+    //   -+-
+    //    |1
+    //
+    // y[n + 1] = y[n] + dt*f(y[n])
+
+    scalar b[1] = { 1 };
+
+    tableau::b(b, 1);
+    order(1);
+  }
+
+  midpoint_tableau::midpoint_tableau() {
+    // Midpoint method. Second order Runge-Kutta method. Requires only two
+    // function evaluations per step. Its tableau is:
+    //
+    //   0  |
+    //   1/2|1/2
+    //   ---+-----
+    //      |0   1
+    //
+    //    k1    = dt*f(y[n])
+    //    k2    = dt*f(y[n] + (dt/2)*k1)
+    // y[n + 1] = y[n] + k2
+
+    scalar a2[1] = { scalar(1)/2 };
+    scalar b[2] = { 0, 1 };
+
+    row(a2, 1);
+    tableau::b(b, 2);
+    order(2);
+  }
+
+  RK4_tableau::RK4_tableau() {
+    // Classical, fourth order Runge-Kutta method. Requires four function
+    // evaluations per step. Its tableau is:
+    //
+    //   0  |
+    //   1/2|1/2
+    //   1/2|0   1/2
+    //   1  |0   0   1
+    //   ---+---------------
+    //      |1/6 1/3 1/3 1/6
+    //
+    //    k1    = dt*f(y[n])
+    //    k2    = dt*f(y[n] + (dt/2)*k1)
+    //    k3    = dt*f(y[n] + (dt/2)*k2)
+    //    k4    = dt*f(y[n] + dt*k3)
+    // y[n + 1] = y[n] + (k1 + 2*k2 + 2*k3 + k4)/6
+
+    scalar a2[1] = { scalar(1)/2 };
+    scalar a3[2] = { 0          , scalar(1)/2 };
+    scalar a4[3] = { 0          , 0          , 1 };
+    scalar b[4] = { scalar(1)/6, scalar(1)/3, scalar(1)/3, scalar(1)/6 };
+
+    row(a2, 1);
+    row(a3, 2);
+    row(a4, 3);
+    tableau::b(b, 4);
+    order(4);
+  }
+
+  RKF45_tableau::RKF45_tableau() {
+    // Fifth-order Runge-Kutta-Fehlberg adaptive method. Requires 6 function
+    // evaluations per step. An embeded fourth-order method gives an estimate
+    // of the local truncation error, which is used to either reject the step
+    // or find a recommendation for the next stepsize.
+
+    scalar a2[1] = { scalar(1)/4 };
+    scalar a3[2] = { scalar(3)/32, scalar(9)/32 };
+    scalar a4[3] = { scalar(1932)/2197, -scalar(7200)/2197, scalar(7296)/2197 };
+    scalar a5[4] = { scalar(439)/216, -8, scalar(3680)/513,
+                     -scalar(845)/4104 };
+    scalar a6[5] = { -scalar(8)/27, 2, -scalar(3544)/2565, scalar(1859)/4104,
+                     -scalar(11)/40 };
+
+    scalar b[6] = { scalar(16)/135, 0, scalar(6656)/12825, scalar(28561)/56430,
+                    -scalar(9)/50, scalar(2)/55 };
+
+    scalar bstar[6] = { scalar(25)/216, 0, scalar(1408)/2565, scalar(2197)/4104,
+                        -scalar(1)/5, 0 };
+
+    // Fehlberg's pair has no continuous extension of its own, but the stages
+    // support one of third order at no extra cost. This one matches f(y[n])
+    // at theta = 0, and integrates c^3 exactly at theta = 1/2.
+    scalar d1[3] = { 1, -scalar(181)/90, scalar(61)/54 };
+    scalar d2[1] = { 0 };
+    scalar d3[3] = { 0, scalar(11072)/4275, -scalar(5312)/2565 };
+    scalar d4[3] = { 0, -scalar(15379)/9405, scalar(2197)/1026 };
+    scalar d5[3] = { 0, scalar(51)/50, -scalar(6)/5 };
+    scalar d6[2] = { 0, scalar(2)/55 };
+
+    row(a2, 1);
+    row(a3, 2);
+    row(a4, 3);
+    row(a5, 4);
+    row(a6, 5);
+    tableau::b(b, 6);
+    tableau::bstar(bstar, 6);
+    dense(d1, 3);
+    dense(d2, 1);
+    dense(d3, 3);
+    dense(d4, 3);
+    dense(d5, 3);
+    dense(d6, 2);
+    order(4);
+  }
+
+  DP45_tableau::DP45_tableau() {
+    // Fifth-order Dormand-Prince adaptive method. Requires 7 function
+    // evaluations, rather than 6, because the FSAL optimization hasn't been
+    // applied in this case.
+
+    scalar a2[1] = { scalar(1)/5 };
+    scalar a3[2] = { scalar(3)/40, scalar(9)/40 };
+    scalar a4[3] = { scalar(44)/45, -scalar(56)/15, scalar(32)/9 };
+    scalar a5[4] = { scalar(19372)/6561, -scalar(25360)/2187,
+                     scalar(64448)/6561, -scalar(212)/729 };
+    scalar a6[5] = { scalar(9017)/3168, -scalar(355)/33, scalar(46732)/5247,
+                     scalar(49)/176, -scalar(5103)/18656 };
+    scalar a7[6] = { scalar(35)/384, 0, scalar(500)/1113, scalar(125)/192,
+                     -scalar(2187)/6784, scalar(11)/84 };
+
+    scalar b[7] = { scalar(35)/384, 0, scalar(500)/1113, scalar(125)/192,
+                    -scalar(2187)/6784, scalar(11)/84, 0 };
+
+    scalar bstar[7] = { scalar(5179)/57600, 0, scalar(7571)/16695,
+                        scalar(393)/640, -scalar(92097)/339200,
+                        scalar(187)/2100, scalar(1)/40 };
+
+    // Shampine's fourth-order continuous extension, which needs no more
+    // evaluations than the step itself
+    scalar d1[4] = { 1, -scalar("8048581381")/scalar("2820520608"),
+                     scalar("8663915743")/scalar("2820520608"),
+                     -scalar("12715105075")/scalar("11282082432") };
+    scalar d2[1] = { 0 };
+    scalar d3[4] = { 0, scalar("131558114200")/scalar("32700410799"),
+                     -scalar("68118460800")/scalar("10900136933"),
+                     scalar("87487479700")/scalar("32700410799") };
+    scalar d4[4] = { 0, -scalar(1754552775)/470086768,
+                     scalar("14199869525")/1410260304,
+                     -scalar("10690763975")/1880347072 };
+    scalar d5[4] = { 0, scalar("127303824393")/scalar("49829197408"),
+                     -scalar("318862633887")/scalar("49829197408"),
+                     scalar("701980252875")/scalar("199316789632") };
+    scalar d6[4] = { 0, -scalar(282668133)/205662961,
+                     scalar(2019193451)/616988883,
+                     -scalar(1453857185)/822651844 };
+    scalar d7[4] = { 0, scalar(40617522)/29380423,
+                     -scalar(110615467)/29380423,
+                     scalar(69997945)/29380423 };
+
+    row(a2, 1);
+    row(a3, 2);
+    row(a4, 3);
+    row(a5, 4);
+    row(a6, 5);
+    row(a7, 6);
+    tableau::b(b, 7);
+    tableau::bstar(bstar, 7);
+    dense(d1, 4);
+    dense(d2, 1);
+    dense(d3, 4);
+    dense(d4, 4);
+    dense(d5, 4);
+    dense(d6, 4);
+    dense(d7, 4);
+    order(4);
+  }
+}
@@ -0,0 +1,131 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+#include <map>
+#include <vector>
+
+namespace carom
+{
+  taylor_state::taylor_state(system& sys) : m_sys(&sys) { }
+
+  system& taylor_state::sys() { return *m_sys; }
+
+  bool taylor_state::expand(unsigned int n) {
+    // The system may have changed since the last expansion
+    m_particles.clear();
+    m_index.clear();
+    for (system::iterator b = m_sys->begin(); b != m_sys->end(); ++b) {
+      if (!dynamic_cast<simple_body*>(&*b)) {
+        return false;
+      }
+      for (body::iterator i = b->begin(); i != b->end(); ++i) {
+        m_index[&*i] = m_particles.size();
+        m_particles.push_back(&*i);
+      }
+    }
+    m_series.resize(m_particles.size(), std::vector<series>(6));
+
+    scalar y[6];
+    for (std::size_t i = 0; i < m_particles.size(); ++i) {
+      flatten(m_particles[i]->s(), y);
+      flatten(m_particles[i]->p(), y + 3);
+      for (unsigned int j = 0; j < 6; ++j) {
+        m_series[i][j][0] = y[j];
+      }
+    }
+
+    // Each coefficient of every particle's force needs the coefficients up
+    // to the same degree of every particle, so go degree by degree
+    scalar F[3], m_inv;
+    for (unsigned int k = 0; k < n; ++k) {
+      std::size_t w = 0;
+      for (std::size_t i = 0; i < m_particles.size(); ++i) {
+        particle* x = m_particles[i];
+        F[0] = F[1] = F[2] = 0;
+        for (particle::iterator f = x->begin(); f != x->end(); ++f, ++w) {
+          if (w == m_work.size()) {
+            m_work.push_back(std::vector<series>());
+          }
+          if (!f->taylor(*x, *this, m_work[w], k, F)) {
+            return false;
+          }
+        }
+
+        // s' = p/m and p' = F
+        std::vector<series>& y = m_series[i];
+        m_inv = convert<scalar>(1/x->m());
+        for (unsigned int j = 0; j < 3; ++j) {
+          y[j][k + 1] = m_inv*y[j + 3][k]/(k + 1);
+          y[j + 3][k + 1] = F[j]/(k + 1);
+        }
+      }
+    }
+
+    // Coefficients past n may be left from a longer expansion
+    for (std::size_t i = 0; i < m_series.size(); ++i) {
+      for (unsigned int j = 0; j < 6; ++j) {
+        m_series[i][j].resize(n + 1);
+      }
+    }
+
+    return true;
+  }
+
+  const series* taylor_state::s(const particle& x) const {
+    std::map<const particle*, std::size_t>::const_iterator i = m_index.find(&x);
+    if (i == m_index.end()) {
+      return 0;
+    }
+    return &m_series[i->second][0];
+  }
+
+  const series* taylor_state::p(const particle& x) const {
+    const series* s = this->s(x);
+    return s ? s + 3 : 0;
+  }
+
+  void taylor_state::error(unsigned int k, error_norm& norm) const {
+    for (std::size_t i = 0; i < m_particles.size(); ++i) {
+      const std::vector<series>& y = m_series[i];
+      for (unsigned int j = 0; j < 6; j += 3) {
+        scalar e = sqrt(y[j][k]*y[j][k] + y[j + 1][k]*y[j + 1][k]
+                        + y[j + 2][k]*y[j + 2][k]);
+        scalar y0 = sqrt(y[j][0]*y[j][0] + y[j + 1][0]*y[j + 1][0]
+                         + y[j + 2][0]*y[j + 2][0]);
+        norm.add(j == 0 ? error_norm::position : error_norm::momentum, e, y0);
+      }
+    }
+  }
+
+  void taylor_state::evaluate(const scalar& h) {
+    scalar y[6];
+    vector_displacement s;
+    vector_momentum p;
+    for (std::size_t i = 0; i < m_particles.size(); ++i) {
+      for (unsigned int j = 0; j < 6; ++j) {
+        y[j] = m_series[i][j](h);
+      }
+      unflatten(s, y);
+      unflatten(p, y + 3);
+      m_particles[i]->s(s);
+      m_particles[i]->p(p);
+    }
+  }
+}
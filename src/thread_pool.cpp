@@ -0,0 +1,154 @@
+/*************************************************************************
+ * Copyright (C) 2008 Tavian Barnes <tavianator@gmail.com>               *
+ *                                                                       *
+ * This file is part of The Carom Library                                *
+ *                                                                       *
+ * The Carom Library is free software; you can redistribute it and/or    *
+ * modify it under the terms of the GNU General Public License as        *
+ * published by the Free Software Foundation; either version 3 of the    *
+ * License, or (at your option) any later version.                       *
+ *                                                                       *
+ * The Carom Library is distributed in the hope that it will be useful,  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ * GNU General Public License for more details.                          *
+ *                                                                       *
+ * You should have received a copy of the GNU General Public License     *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *************************************************************************/
+
+#include <carom.hpp>
+#include <boost/bind/bind.hpp>
+#include <algorithm> // For max()
+
+namespace carom
+{
+  thread_pool::thread_pool(unsigned int n)
+    : m_size(std::max(n, 1U)), m_ranges(new range[m_size]), m_generation(0),
+      m_busy(0), m_running(false), m_stop(false), m_task(0),
+      m_precision(precision()) {
+    for (unsigned int i = 1; i < m_size; ++i) {
+      m_threads.create_thread(boost::bind(&thread_pool::main, this, i));
+    }
+  }
+
+  thread_pool::~thread_pool() {
+    {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_start.notify_all();
+    m_threads.join_all();
+  }
+
+  unsigned int thread_pool::size() const { return m_size; }
+
+  void thread_pool::run(std::size_t n, const task& f) {
+    bool serial = m_size == 1 || n < 2;
+    if (!serial) {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      serial = m_running;
+      m_running = true;
+    }
+    if (serial) {
+      for (std::size_t i = 0; i < n; ++i) {
+        f(i);
+      }
+      return;
+    }
+
+    // The workers are idle, so the ranges are ours until they start
+    for (unsigned int i = 0; i < m_size; ++i) {
+      m_ranges[i].begin = n*i/m_size;
+      m_ranges[i].end   = n*(i + 1)/m_size;
+    }
+
+    {
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      m_task = &f;
+      m_precision = precision();
+      m_busy = m_size - 1;
+      ++m_generation;
+    }
+    m_start.notify_all();
+
+    work(0);
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_busy != 0) {
+      m_done.wait(lock);
+    }
+    m_task = 0;
+    m_running = false;
+  }
+
+  void thread_pool::main(unsigned int id) {
+    // Scalars made on this thread come from its own pool
+    optimization pool;
+    unsigned long generation = 0;
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (true) {
+      while (!m_stop && m_generation == generation) {
+        m_start.wait(lock);
+      }
+      if (m_stop) {
+        return;
+      }
+      generation = m_generation;
+      lock.unlock();
+
+      precision(m_precision);
+      work(id);
+
+      lock.lock();
+      if (--m_busy == 0) {
+        m_done.notify_all();
+      }
+    }
+  }
+
+  void thread_pool::work(unsigned int id) {
+    range& r = m_ranges[id];
+    std::size_t i = 0;
+    bool found;
+    while (true) {
+      {
+        boost::lock_guard<boost::mutex> lock(r.mutex);
+        found = r.begin < r.end;
+        if (found) {
+          i = r.begin++;
+        }
+      }
+
+      if (found) {
+        (*m_task)(i);
+      } else if (!steal(id)) {
+        return;
+      }
+    }
+  }
+
+  bool thread_pool::steal(unsigned int id) {
+    for (unsigned int j = 1; j < m_size; ++j) {
+      range& victim = m_ranges[(id + j)%m_size];
+      std::size_t begin, end;
+      {
+        boost::lock_guard<boost::mutex> lock(victim.mutex);
+        if (victim.begin >= victim.end) {
+          continue;
+        }
+        // The back half, rounded up
+        begin = victim.begin + (victim.end - victim.begin)/2;
+        end = victim.end;
+        victim.end = begin;
+      }
+
+      boost::lock_guard<boost::mutex> lock(m_ranges[id].mutex);
+      m_ranges[id].begin = begin;
+      m_ranges[id].end = end;
+      return true;
+    }
+    return false;
+  }
+}